@@ -7,30 +7,41 @@
 #include <errno.h>
 #include <unistd.h>
 
-static int creadteNonblocking()
+static int creadteNonblocking(sa_family_t family)
 {
-    int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (sockfd < 0)
     {
         LOG_FATAL("%s:%s:%d listen socket creatr err: %d \n", __FILE__, __FUNCTION__, __LINE__, errno);
     }
+    return sockfd;
 }
 
 Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport)
     : loop_(loop),
-      acceptSocket_(creadteNonblocking()),
+      acceptSocket_(creadteNonblocking(listenAddr.family())),
       acceptChannel_(loop, acceptSocket_.fd()),
-      listening_(false)
+      listenAddr_(listenAddr),
+      needBind_(true),
+      listening_(false),
+      unixDomain_(listenAddr.isUnixDomain())
 {
-    acceptSocket_.setReuseAddr(true);
-    acceptSocket_.setReusePort(true);
-    acceptSocket_.bindAddress(listenAddr);
-
     // TcpServer::start() Acceptor.listen 有新用户连接，要执行一个回调 connfd->channel->subloop
     // baseloop -> acceptChannel_(listenfd) ->
     acceptChannel_.setReadCallback(std::bind(&Acceptor::handleRead, this));
 }
 
+Acceptor::Acceptor(EventLoop *loop, int listenfd)
+    : loop_(loop),
+      acceptSocket_(listenfd),
+      acceptChannel_(loop, listenfd),
+      needBind_(false),
+      listening_(false),
+      unixDomain_(InetAddress::localAddressOf(listenfd).isUnixDomain())
+{
+    acceptChannel_.setReadCallback(std::bind(&Acceptor::handleRead, this));
+}
+
 Acceptor::~Acceptor()
 {
     acceptChannel_.disableAll();
@@ -40,10 +51,40 @@ Acceptor::~Acceptor()
 void Acceptor::listen()
 {
     listening_ = true;
-    acceptSocket_.listen();
+    // bind推迟到listen 零停机重启时新进程构造的Acceptor会被接管来的fd替换 不能提前删掉旧进程还在用的socket文件
+    if (needBind_)
+    {
+        needBind_ = false;
+        if (unixDomain_)
+        {
+            // 文件系统中的Unix域地址，删除上次运行留下的socket文件，abstract namespace不需要
+            std::string path = listenAddr_.toIp();
+            if (!path.empty() && path[0] != '@')
+            {
+                ::unlink(path.c_str());
+            }
+        }
+        else
+        {
+            acceptSocket_.setReuseAddr(true);
+            acceptSocket_.setReusePort(true);
+        }
+        acceptSocket_.bindAddress(listenAddr_);
+    }
+    if (!unixDomain_)
+    {
+        acceptSocket_.applyListenOptions(options_);
+    }
+    acceptSocket_.listen(options_.backlog);
     acceptChannel_.enableReading(); // acceptChannel -> Poller
 }
 
+void Acceptor::stopListening()
+{
+    listening_ = false;
+    acceptChannel_.disableAll();
+}
+
 // listenfd有事件发生了，就是有新用户连接
 void Acceptor::handleRead()
 {
@@ -3,17 +3,19 @@
 #include "noncopyable.h"
 #include "Socket.h"
 #include "Channel.h"
+#include "InetAddress.h"
 
 #include <functional>
 
 class EventLoop;
-class InetAddress;
 
 class Acceptor : noncopyable
 {
 public:
     using NewConnectionCallback = std::function<void(int sockfd, const InetAddress &)>;
     Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport);
+    // 接管一个已经bind并listen的fd 用于零停机重启
+    Acceptor(EventLoop *loop, int listenfd);
     ~Acceptor();
 
     void setNewConnectionCallback(const NewConnectionCallback &cb)
@@ -21,7 +23,12 @@ public:
         newConnectionCallback_ = cb;
     }
     bool listening() const { return listening_; }
+    // 必须在listen之前设置 Unix域socket只使用backlog
+    void setSocketOptions(const SocketOptions &options) { options_ = options; }
     void listen();
+    // 不再accept新连接，监听fd保持打开 已经在队列中的连接留给接管的进程
+    void stopListening();
+    int fd() const { return acceptSocket_.fd(); }
 
 private:
     void handleRead();
@@ -30,5 +37,9 @@ private:
     Socket acceptSocket_;
     Channel acceptChannel_;
     NewConnectionCallback newConnectionCallback_;
+    InetAddress listenAddr_;
+    bool needBind_; // 接管来的fd已经bind过 不能再碰Unix域地址的socket文件
     bool listening_;
+    bool unixDomain_;
+    SocketOptions options_;
 };
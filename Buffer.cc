@@ -1,17 +1,26 @@
 #include "Buffer.h"
 
+#include <algorithm>
 #include <errno.h>
 #include <sys/uio.h>
 #include <unistd.h>
 
+const size_t Buffer::kMinReadHint;
+const size_t Buffer::kMaxReadHint;
+
 /*
 从fd上读取数据 Poller工作在LT模式(数据不会丢失)
 Buffer缓冲区有大小，但是从fd上读数据的时候，不知道tcp数据最终的大小
+可写空间不够最近几次读取的平均大小时先扩容，大部分读取直接落在Buffer里，超出的部分再从栈上的extrabuf拷贝
 */
 
 ssize_t Buffer::readFd(int fd, int *saveErrno)
 {
-    char extrabuf[65536] = {0}; // 栈上的内存空间 64K
+    char extrabuf[65536]; // 栈上的内存空间 64K 只接收超出的部分，不需要清零
+    if (writableBytes() < readHint_)
+    {
+        ensureWriteableBytes(readHint_);
+    }
     struct iovec vec[2];
     const size_t writable = writableBytes(); // 这是Buffer底层缓冲区剩余的可写空间大小
     vec[0].iov_base = begin() + writerIndex_;
@@ -25,6 +34,7 @@ ssize_t Buffer::readFd(int fd, int *saveErrno)
     if (n < 0)
     {
         *saveErrno = errno;
+        return n;
     }
     else if (n <= writable) // Buffer的可写缓冲区已经够存储读出来的数据了
     {
@@ -32,16 +42,27 @@ ssize_t Buffer::readFd(int fd, int *saveErrno)
     }
     else
     {
-        writerIndex_ = buffer_.size();
+        writerIndex_ += writable;
         append(extrabuf, n - writable);
     }
 
+    if (n > 0)
+    {
+        // 权重1/8 偶尔一次大的读取不会让之后每次都准备很大的空间
+        readHint_ = readHint_ - readHint_ / 8 + static_cast<size_t>(n) / 8;
+        readHint_ = std::min(std::max(readHint_, kMinReadHint), kMaxReadHint);
+    }
     return n;
 }
 
 ssize_t Buffer::writeFd(int fd, int *saveErrno)
 {
-    ssize_t n = ::write(fd, peek(), readableBytes());
+    return writeFd(fd, readableBytes(), saveErrno);
+}
+
+ssize_t Buffer::writeFd(int fd, size_t maxBytes, int *saveErrno)
+{
+    ssize_t n = ::write(fd, peek(), std::min(maxBytes, readableBytes()));
     if (n < 0)
     {
         *saveErrno = errno;
@@ -1,22 +1,140 @@
 #pragma once
 
 #include "copyable.h"
+#include "BufferSearch.h"
+#include "BufferAccountant.h"
+#include "BufferAllocator.h"
 
-#include <vector>
 #include <string>
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
+#include <assert.h>
 
-// 网络库底层缓冲区
+/*
+网络库底层缓冲区
+分配器是BufferAllocator::mirrored()时按环形缓冲区使用：可读数据之后的空闲空间和之前的空闲空间是同一块，
+retrieve只移动读下标，读下标越过容量时两个下标一起减去容量，append和readFd不再需要把可读数据挪回开头
+*/
 class Buffer : public copyable
 {
 public:
     static const size_t kCheapPrepend = 8;   // 预留八字节
     static const size_t kInitialSize = 1024; // 初始化长度
+    static const size_t npos = static_cast<size_t>(-1);
+    static const size_t kMinReadHint = 256;        // readFd预先准备的可写空间的上下限
+    static const size_t kMaxReadHint = 64 * 1024;
 
-    explicit Buffer(size_t initialSize = kInitialSize)
-        : buffer_(kCheapPrepend + initialSize),
+    /*
+    allocator为空时使用BufferAllocator::heap() TcpConnection使用所在loop的BufferArena
+    initialSize为0时不分配底层存储，第一次写入时再分配
+    */
+    explicit Buffer(size_t initialSize = kInitialSize, BufferAllocator *allocator = nullptr)
+        : allocator_(allocator ? allocator : BufferAllocator::heap()),
+          mirrored_(allocator_->isMirrored()),
+          data_(nullptr),
+          capacity_(0),
           readerIndex_(kCheapPrepend),
-          writerIndex_(kCheapPrepend)
+          writerIndex_(kCheapPrepend),
+          readHint_(kInitialSize)
     {
+        if (initialSize > 0)
+        {
+            data_ = allocate(allocator_, kCheapPrepend + initialSize, &capacity_);
+        }
+        else
+        {
+            resetStorage();
+        }
+    }
+
+    // 拷贝只复制可读数据 使用同一个分配器
+    Buffer(const Buffer &rhs)
+        : allocator_(rhs.allocator_),
+          mirrored_(rhs.mirrored_),
+          data_(nullptr),
+          capacity_(0),
+          readerIndex_(kCheapPrepend),
+          writerIndex_(kCheapPrepend),
+          readHint_(rhs.readHint_)
+    {
+        data_ = allocate(allocator_, kCheapPrepend + rhs.readableBytes(), &capacity_);
+        append(rhs.peek(), rhs.readableBytes());
+    }
+
+    Buffer &operator=(Buffer rhs)
+    {
+        swap(rhs);
+        return *this;
+    }
+
+    ~Buffer()
+    {
+        deallocate();
+    }
+
+    void swap(Buffer &rhs)
+    {
+        std::swap(allocator_, rhs.allocator_);
+        std::swap(mirrored_, rhs.mirrored_);
+        std::swap(data_, rhs.data_);
+        std::swap(capacity_, rhs.capacity_);
+        std::swap(readerIndex_, rhs.readerIndex_);
+        std::swap(writerIndex_, rhs.writerIndex_);
+        std::swap(readHint_, rhs.readHint_);
+    }
+
+    // 底层存储的大小 线性模式下包括预留的kCheapPrepend 还没有分配或者已经释放时为0
+    size_t internalCapacity() const
+    {
+        return data_ ? capacity_ : 0;
+    }
+
+    BufferAllocator *allocator() const { return allocator_; }
+    bool mirrored() const { return mirrored_; }
+
+    // 把底层存储换成allocator分配的，之后的扩容也使用它 连接迁移到其他loop后换成新loop的内存池
+    void rebind(BufferAllocator *allocator)
+    {
+        if (allocator == allocator_)
+        {
+            return;
+        }
+        if (data_ == nullptr)
+        {
+            allocator_ = allocator;
+            mirrored_ = allocator->isMirrored();
+            resetStorage();
+        }
+        else
+        {
+            reallocate(allocator, std::max(capacity_, kCheapPrepend + readableBytes()));
+        }
+    }
+
+    // 没有可读数据时把底层存储还给分配器，下次写入时再分配 返回是否释放了内存
+    bool release()
+    {
+        if (data_ == nullptr || readableBytes() > 0)
+        {
+            return false;
+        }
+        deallocate();
+        resetStorage();
+        return true;
+    }
+
+    // 把底层存储收缩到可读数据加reserve字节，释放多余的内存 返回是否真的变小了
+    bool shrink(size_t reserve)
+    {
+        size_t size = allocator_->goodSize(kCheapPrepend + readableBytes() + reserve);
+        if (size >= capacity_)
+        {
+            return false;
+        }
+        reallocate(allocator_, size);
+        return true;
     }
 
     size_t readableBytes() const
@@ -26,12 +144,13 @@ public:
 
     size_t writableBytes() const
     {
-        return buffer_.size() - writerIndex_;
+        return mirrored_ ? capacity_ - readableBytes() : capacity_ - writerIndex_;
     }
 
+    // 环形模式下可读数据前后的空闲空间是同一块
     size_t prependableBytes() const
     {
-        return readerIndex_;
+        return mirrored_ ? capacity_ - readableBytes() : readerIndex_;
     }
 
     // 返回缓冲区中可读数据的起始地址
@@ -40,12 +159,49 @@ public:
         return begin() + readerIndex_;
     }
 
+    // 可写的可读数据起始地址 用于就地解码(如WebSocket去掩码)
+    char *mutablePeek()
+    {
+        return begin() + readerIndex_;
+    }
+
+    /*
+    在可读数据中从offset开始查找，返回相对peek()的偏移，找不到返回npos
+    数据不完整时记下返回npos前的readableBytes()，下次从那里继续，避免重复扫描
+    (findCRLF需要从readableBytes()-1继续，最后一个字节可能是'\r')
+    */
+    size_t findCRLF(size_t offset = 0) const
+    {
+        return search(BufferSearch::findCRLF(peek() + clamp(offset), beginWrite()));
+    }
+
+    size_t findEOL(size_t offset = 0) const
+    {
+        return findByte('\n', offset);
+    }
+
+    size_t findByte(char c, size_t offset = 0) const
+    {
+        return search(BufferSearch::findByte(peek() + clamp(offset), beginWrite(), c));
+    }
+
+    size_t findAny(const char *set, size_t setLen, size_t offset = 0) const
+    {
+        return search(BufferSearch::findAny(peek() + clamp(offset), beginWrite(), set, setLen));
+    }
+
     // onMessage string <- Buffer
     void retrieve(size_t len)
     {
         if (len < readableBytes())
         {
             readerIndex_ += len; // 应用只读取了可读缓冲区的一部分
+            if (mirrored_ && readerIndex_ >= capacity_)
+            {
+                // 读下标进入第二个映射 换回第一个映射中的同一位置
+                readerIndex_ -= capacity_;
+                writerIndex_ -= capacity_;
+            }
         }
         else
         {
@@ -72,6 +228,131 @@ public:
         return result;
     }
 
+    // 网络字节序的整数读写 read = peek + retrieve
+    int64_t readInt64()
+    {
+        int64_t result = peekInt64();
+        retrieve(sizeof result);
+        return result;
+    }
+
+    int32_t readInt32()
+    {
+        int32_t result = peekInt32();
+        retrieve(sizeof result);
+        return result;
+    }
+
+    int16_t readInt16()
+    {
+        int16_t result = peekInt16();
+        retrieve(sizeof result);
+        return result;
+    }
+
+    int8_t readInt8()
+    {
+        int8_t result = peekInt8();
+        retrieve(sizeof result);
+        return result;
+    }
+
+    // 调用前需要保证 readableBytes() >= sizeof(intN_t)
+    int64_t peekInt64() const
+    {
+        assert(readableBytes() >= sizeof(int64_t));
+        int64_t be64 = 0;
+        ::memcpy(&be64, peek(), sizeof be64);
+        return be64toh(be64);
+    }
+
+    int32_t peekInt32() const
+    {
+        assert(readableBytes() >= sizeof(int32_t));
+        int32_t be32 = 0;
+        ::memcpy(&be32, peek(), sizeof be32);
+        return be32toh(be32);
+    }
+
+    int16_t peekInt16() const
+    {
+        assert(readableBytes() >= sizeof(int16_t));
+        int16_t be16 = 0;
+        ::memcpy(&be16, peek(), sizeof be16);
+        return be16toh(be16);
+    }
+
+    int8_t peekInt8() const
+    {
+        assert(readableBytes() >= sizeof(int8_t));
+        return *peek();
+    }
+
+    void appendInt64(int64_t x)
+    {
+        int64_t be64 = htobe64(x);
+        append(reinterpret_cast<const char *>(&be64), sizeof be64);
+    }
+
+    void appendInt32(int32_t x)
+    {
+        int32_t be32 = htobe32(x);
+        append(reinterpret_cast<const char *>(&be32), sizeof be32);
+    }
+
+    void appendInt16(int16_t x)
+    {
+        int16_t be16 = htobe16(x);
+        append(reinterpret_cast<const char *>(&be16), sizeof be16);
+    }
+
+    void appendInt8(int8_t x)
+    {
+        append(reinterpret_cast<const char *>(&x), sizeof x);
+    }
+
+    // 把数据写到可读数据的前面，使用kCheapPrepend预留的空间，不需要移动已有数据
+    void prepend(const void *data, size_t len)
+    {
+        if (data_ == nullptr)
+        {
+            makeSpace(len); // 还没有分配存储时线性模式的prependableBytes()也是kCheapPrepend
+        }
+        assert(len <= prependableBytes());
+        if (mirrored_ && readerIndex_ < len)
+        {
+            // 换到第二个映射中的同一位置 前面的空闲空间是从第一个映射的末尾回绕过来的
+            readerIndex_ += capacity_;
+            writerIndex_ += capacity_;
+        }
+        readerIndex_ -= len;
+        const char *d = static_cast<const char *>(data);
+        std::copy(d, d + len, begin() + readerIndex_);
+    }
+
+    void prependInt64(int64_t x)
+    {
+        int64_t be64 = htobe64(x);
+        prepend(&be64, sizeof be64);
+    }
+
+    void prependInt32(int32_t x)
+    {
+        int32_t be32 = htobe32(x);
+        prepend(&be32, sizeof be32);
+    }
+
+    void prependInt16(int16_t x)
+    {
+        int16_t be16 = htobe16(x);
+        prepend(&be16, sizeof be16);
+    }
+
+    void prependInt8(int8_t x)
+    {
+        prepend(&x, sizeof x);
+    }
+
     void ensureWriteableBytes(size_t len)
     {
         if (writableBytes() < len)
@@ -102,23 +383,83 @@ public:
     ssize_t readFd(int fd, int *saveErrno);
     // 通过fd发送数据
     ssize_t writeFd(int fd, int *saveErrno);
+    // 最多发送maxBytes字节 用于限速发送
+    ssize_t writeFd(int fd, size_t maxBytes, int *saveErrno);
 
 private:
     char *begin()
     {
-        return &*buffer_.begin(); // vector底层数组首元素的地址，也就是数组的起始地址
+        return data_;
     }
 
     const char *begin() const
     {
-        return &*buffer_.begin();
+        return data_;
+    }
+
+    // 底层存储的分配和释放都要记到BufferAccountant上
+    static char *allocate(BufferAllocator *allocator, size_t size, size_t *capacity)
+    {
+        char *data = allocator->allocate(size, capacity);
+        BufferAccountant::instance().charge(*capacity);
+        return data;
+    }
+
+    void deallocate()
+    {
+        if (data_ != nullptr)
+        {
+            BufferAccountant::instance().release(capacity_);
+            allocator_->deallocate(data_, capacity_);
+        }
+    }
+
+    // 没有底层存储的状态 可写空间为0，下次写入时由makeSpace分配
+    void resetStorage()
+    {
+        data_ = nullptr;
+        capacity_ = mirrored_ ? 0 : kCheapPrepend;
+        readerIndex_ = kCheapPrepend;
+        writerIndex_ = kCheapPrepend;
+    }
+
+    // 换一块至少size字节的存储 只拷贝可读数据，新的部分不做清零
+    void reallocate(BufferAllocator *allocator, size_t size)
+    {
+        size_t readable = readableBytes();
+        size_t capacity = 0;
+        char *data = allocate(allocator, size, &capacity);
+        if (readable > 0)
+        {
+            ::memcpy(data + kCheapPrepend, peek(), readable);
+        }
+        deallocate();
+        allocator_ = allocator;
+        mirrored_ = allocator->isMirrored();
+        data_ = data;
+        capacity_ = capacity;
+        readerIndex_ = kCheapPrepend;
+        writerIndex_ = kCheapPrepend + readable;
+    }
+
+    size_t clamp(size_t offset) const
+    {
+        return offset < readableBytes() ? offset : readableBytes();
+    }
+
+    // 把查找结果转换为相对peek()的偏移
+    size_t search(const char *found) const
+    {
+        return found == beginWrite() ? npos : static_cast<size_t>(found - peek());
     }
 
     void makeSpace(size_t len)
     {
-        if (writableBytes() + prependableBytes() < len + kCheapPrepend)
+        if (mirrored_ || writableBytes() + prependableBytes() < len + kCheapPrepend)
         {
-            buffer_.resize(writerIndex_ + len);
+            // 至少翻倍扩容 和原来vector::resize的均摊复杂度一致 第一次分配至少kInitialSize
+            size_t atLeast = data_ ? capacity_ * 2 : kCheapPrepend + kInitialSize;
+            reallocate(allocator_, std::max(kCheapPrepend + readableBytes() + len, atLeast));
         }
         else
         {
@@ -131,7 +472,11 @@ private:
         }
     }
 
-    std::vector<char> buffer_;
+    BufferAllocator *allocator_;
+    bool mirrored_;
+    char *data_;
+    size_t capacity_;
     size_t readerIndex_;
     size_t writerIndex_;
+    size_t readHint_; // 最近几次readFd读到的字节数的指数加权平均
 };
\ No newline at end of file
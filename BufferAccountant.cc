@@ -0,0 +1,79 @@
+#include "BufferAccountant.h"
+#include "CurrentThread.h"
+
+BufferAccountant &BufferAccountant::instance()
+{
+    static BufferAccountant accountant;
+    return accountant;
+}
+
+BufferAccountant::BufferAccountant()
+    : softLimit_(0),
+      hardLimit_(0),
+      throttled_(0),
+      shrunk_(0),
+      refused_(0),
+      evicted_(0)
+{
+    for (int i = 0; i < kNumShards; ++i)
+    {
+        shards_[i].bytes.store(0, std::memory_order_relaxed);
+    }
+}
+
+std::atomic<int64_t> &BufferAccountant::shard()
+{
+    // 每个线程固定使用一个分片 同一个loop线程的记账不会和其他线程争用缓存行
+    static thread_local int index = CurrentThread::tid() % kNumShards;
+    return shards_[index].bytes;
+}
+
+int64_t BufferAccountant::totalBytes() const
+{
+    int64_t total = 0;
+    for (int i = 0; i < kNumShards; ++i)
+    {
+        // Buffer可以在一个线程分配、另一个线程释放，单个分片可能为负
+        total += shards_[i].bytes.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void BufferAccountant::setLimits(size_t softLimit, size_t hardLimit)
+{
+    softLimit_.store(softLimit, std::memory_order_relaxed);
+    hardLimit_.store(hardLimit, std::memory_order_relaxed);
+}
+
+BufferAccountant::Pressure BufferAccountant::pressure() const
+{
+    size_t soft = softLimit();
+    size_t hard = hardLimit();
+    if (soft == 0 && hard == 0)
+    {
+        return kNormal;
+    }
+    int64_t total = totalBytes();
+    if (hard > 0 && total >= static_cast<int64_t>(hard))
+    {
+        return kHard;
+    }
+    if (soft > 0 && total >= static_cast<int64_t>(soft))
+    {
+        return kSoft;
+    }
+    return kNormal;
+}
+
+BufferAccountant::Stats BufferAccountant::stats() const
+{
+    Stats s;
+    s.totalBytes = totalBytes();
+    s.softLimit = softLimit();
+    s.hardLimit = hardLimit();
+    s.throttledConnections = throttled_.load(std::memory_order_relaxed);
+    s.shrunkBuffers = shrunk_.load(std::memory_order_relaxed);
+    s.refusedAccepts = refused_.load(std::memory_order_relaxed);
+    s.evictedConnections = evicted_.load(std::memory_order_relaxed);
+    return s;
+}
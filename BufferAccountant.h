@@ -0,0 +1,75 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+进程内所有Buffer占用内存的统计 每个Buffer分配和释放底层存储时记账
+计数按线程分散到多个缓存行对齐的分片上，记账只是一次本线程分片上的relaxed加法，读总数时再把分片加起来
+软上限和硬上限由TcpServer::setMemoryLimits设置，超过后由TcpServer定时检查并做出响应
+*/
+class BufferAccountant : noncopyable
+{
+public:
+    enum Pressure
+    {
+        kNormal, // 低于软上限
+        kSoft,   // 超过软上限 暂停最大的连接读取，收缩空闲缓冲区
+        kHard,   // 超过硬上限 拒绝新连接，关闭占用最多的连接
+    };
+
+    struct Stats
+    {
+        int64_t totalBytes;
+        size_t softLimit;
+        size_t hardLimit;
+        uint64_t throttledConnections; // 因为软上限被暂停读取的连接次数
+        uint64_t shrunkBuffers;        // 收缩的空闲缓冲区个数
+        uint64_t refusedAccepts;       // 超过硬上限时拒绝的新连接
+        uint64_t evictedConnections;   // 超过硬上限时关闭的连接
+    };
+
+    static BufferAccountant &instance();
+
+    void charge(size_t bytes) { shard().fetch_add(static_cast<int64_t>(bytes), std::memory_order_relaxed); }
+    void release(size_t bytes) { shard().fetch_sub(static_cast<int64_t>(bytes), std::memory_order_relaxed); }
+
+    // 所有分片的总和 其他线程正在记账时只是近似值
+    int64_t totalBytes() const;
+
+    // 0表示不限制
+    void setLimits(size_t softLimit, size_t hardLimit);
+    size_t softLimit() const { return softLimit_.load(std::memory_order_relaxed); }
+    size_t hardLimit() const { return hardLimit_.load(std::memory_order_relaxed); }
+    Pressure pressure() const;
+
+    void recordThrottled() { throttled_.fetch_add(1, std::memory_order_relaxed); }
+    void recordShrunk() { shrunk_.fetch_add(1, std::memory_order_relaxed); }
+    void recordRefusedAccept() { refused_.fetch_add(1, std::memory_order_relaxed); }
+    void recordEvicted() { evicted_.fetch_add(1, std::memory_order_relaxed); }
+    Stats stats() const;
+
+private:
+    static const int kNumShards = 16;
+
+    // 对齐到缓存行 数组中相邻的分片不会落在同一个缓存行上
+    struct alignas(64) Shard
+    {
+        std::atomic<int64_t> bytes;
+        char pad[64 - sizeof(std::atomic<int64_t>)];
+    };
+
+    BufferAccountant();
+    std::atomic<int64_t> &shard();
+
+    Shard shards_[kNumShards];
+    std::atomic<size_t> softLimit_;
+    std::atomic<size_t> hardLimit_;
+    std::atomic<uint64_t> throttled_;
+    std::atomic<uint64_t> shrunk_;
+    std::atomic<uint64_t> refused_;
+    std::atomic<uint64_t> evicted_;
+};
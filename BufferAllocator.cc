@@ -0,0 +1,97 @@
+#include "BufferAllocator.h"
+#include "Logger.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <new>
+
+namespace
+{
+class HeapBufferAllocator : public BufferAllocator
+{
+public:
+    char *allocate(size_t size, size_t *capacity) override
+    {
+        char *data = static_cast<char *>(::malloc(size));
+        if (data == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        *capacity = size;
+        return data;
+    }
+
+    void deallocate(char *data, size_t) override
+    {
+        ::free(data);
+    }
+};
+
+class MirroredBufferAllocator : public BufferAllocator
+{
+public:
+    MirroredBufferAllocator() : pageSize_(static_cast<size_t>(::sysconf(_SC_PAGESIZE))) {}
+
+    char *allocate(size_t size, size_t *capacity) override
+    {
+        size = goodSize(size);
+        int fd = ::memfd_create("mymuduo-buffer", MFD_CLOEXEC);
+        if (fd < 0)
+        {
+            LOG_ERROR("MirroredBufferAllocator memfd_create error:%d \n", errno);
+            throw std::bad_alloc();
+        }
+        // 先占住两倍大小的地址空间，再把memfd固定映射到前后两半
+        char *data = nullptr;
+        void *base = ::mmap(nullptr, size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (::ftruncate(fd, static_cast<off_t>(size)) == 0 && base != MAP_FAILED &&
+            ::mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED &&
+            ::mmap(static_cast<char *>(base) + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED)
+        {
+            data = static_cast<char *>(base);
+        }
+        int savedErrno = errno;
+        ::close(fd); // 映射持有memfd的引用
+        if (data == nullptr)
+        {
+            LOG_ERROR("MirroredBufferAllocator mmap error:%d \n", savedErrno);
+            if (base != MAP_FAILED)
+            {
+                ::munmap(base, size * 2);
+            }
+            throw std::bad_alloc();
+        }
+        *capacity = size;
+        return data;
+    }
+
+    void deallocate(char *data, size_t capacity) override
+    {
+        ::munmap(data, capacity * 2);
+    }
+
+    size_t goodSize(size_t size) const override
+    {
+        return (size + pageSize_ - 1) / pageSize_ * pageSize_;
+    }
+
+    bool isMirrored() const override { return true; }
+
+private:
+    size_t pageSize_;
+};
+} // namespace
+
+BufferAllocator *BufferAllocator::heap()
+{
+    static HeapBufferAllocator allocator;
+    return &allocator;
+}
+
+BufferAllocator *BufferAllocator::mirrored()
+{
+    static MirroredBufferAllocator allocator;
+    return &allocator;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+Buffer底层存储的分配器 Buffer通过它申请和归还整块内存
+分配器可以把请求的大小向上取整，实际大小通过capacity返回，归还时传回同样的大小
+返回的内存不做清零
+*/
+class BufferAllocator
+{
+public:
+    virtual ~BufferAllocator() = default;
+
+    virtual char *allocate(size_t size, size_t *capacity) = 0;
+    virtual void deallocate(char *data, size_t capacity) = 0;
+    // 申请size字节时实际会得到的大小
+    virtual size_t goodSize(size_t size) const { return size; }
+    // 返回的内存后面紧跟着同一块物理内存的第二个映射 Buffer按环形缓冲区使用
+    virtual bool isMirrored() const { return false; }
+
+    // 默认的分配器 直接使用malloc/free 可以在任意线程使用
+    static BufferAllocator *heap();
+    /*
+    镜像映射的分配器 可以在任意线程使用
+    每块内存是一个memfd在虚拟地址上连续映射两次，大小按页取整，写过末尾会落到开头，
+    Buffer的可读数据和可写空间总是连续的，回绕不需要移动数据
+    每块内存需要几次系统调用，适合长时间流式收发的连接
+    */
+    static BufferAllocator *mirrored();
+};
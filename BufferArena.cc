@@ -0,0 +1,209 @@
+#include "BufferArena.h"
+#include "CurrentThread.h"
+#include "Logger.h"
+
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <new>
+
+const size_t BufferArena::kRegionSize;
+const size_t BufferArena::kMinChunkSize;
+const size_t BufferArena::kMaxChunkSize;
+
+BufferArena::BufferArena()
+    : ownerTid_(CurrentThread::tid()),
+      hugeRegions_(0),
+      cursor_(nullptr),
+      regionEnd_(nullptr),
+      refs_(1),
+      detached_(false)
+{
+    for (int i = 0; i < kNumClasses; ++i)
+    {
+        localFree_[i] = nullptr;
+        remoteFree_[i] = nullptr;
+    }
+}
+
+BufferArena::~BufferArena()
+{
+    for (auto &region : regions_)
+    {
+        ::munmap(region.first, region.second);
+    }
+}
+
+int BufferArena::sizeClass(size_t size)
+{
+    int index = 0;
+    while (classSize(index) < size)
+    {
+        ++index;
+    }
+    return index;
+}
+
+bool BufferArena::isOwnerThread() const
+{
+    return !detached_.load(std::memory_order_relaxed) && CurrentThread::tid() == ownerTid_;
+}
+
+char *BufferArena::allocate(size_t size, size_t *capacity)
+{
+    refs_.fetch_add(1, std::memory_order_relaxed);
+    if (size > kMaxChunkSize)
+    {
+        char *data = static_cast<char *>(::malloc(size));
+        if (data == nullptr)
+        {
+            refs_.fetch_sub(1, std::memory_order_relaxed);
+            throw std::bad_alloc();
+        }
+        *capacity = size;
+        return data;
+    }
+
+    int index = sizeClass(size);
+    *capacity = classSize(index);
+    if (isOwnerThread())
+    {
+        FreeChunk *chunk = localFree_[index];
+        if (chunk == nullptr)
+        {
+            // 本地链表空了 一次性收回其他线程归还的块
+            std::unique_lock<std::mutex> lock(mutex_);
+            chunk = remoteFree_[index];
+            remoteFree_[index] = nullptr;
+            if (chunk == nullptr)
+            {
+                return allocateLocked(index);
+            }
+        }
+        localFree_[index] = chunk->next;
+        return reinterpret_cast<char *>(chunk);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    return allocateLocked(index);
+}
+
+// 调用前持有mutex_ 优先复用远端链表上的块，否则从当前区域切一块
+char *BufferArena::allocateLocked(int index)
+{
+    FreeChunk *chunk = remoteFree_[index];
+    if (chunk != nullptr)
+    {
+        remoteFree_[index] = chunk->next;
+        return reinterpret_cast<char *>(chunk);
+    }
+
+    size_t size = classSize(index);
+    if (static_cast<size_t>(regionEnd_ - cursor_) < size)
+    {
+        // 区域剩下的部分按从大到小切成块挂到远端链表上，不浪费
+        for (int i = index - 1; i >= 0; --i)
+        {
+            while (static_cast<size_t>(regionEnd_ - cursor_) >= classSize(i))
+            {
+                FreeChunk *rest = reinterpret_cast<FreeChunk *>(cursor_);
+                rest->next = remoteFree_[i];
+                remoteFree_[i] = rest;
+                cursor_ += classSize(i);
+            }
+        }
+        mapRegion();
+    }
+    char *data = cursor_;
+    cursor_ += size;
+    return data;
+}
+
+// 调用前持有mutex_ 映射的内存由内核按需分配物理页，这里不做任何初始化
+void BufferArena::mapRegion()
+{
+    char *region = static_cast<char *>(::mmap(nullptr, kRegionSize, PROT_READ | PROT_WRITE,
+                                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0));
+    if (region != MAP_FAILED)
+    {
+        ++hugeRegions_;
+        regions_.push_back(std::make_pair(region, kRegionSize));
+    }
+    else
+    {
+        // 没有预留大页 多映射一个区域大小，对齐到2MB边界再把两头多余的部分还给内核，让透明大页可以生效
+        char *raw = static_cast<char *>(::mmap(nullptr, kRegionSize * 2, PROT_READ | PROT_WRITE,
+                                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (raw == MAP_FAILED)
+        {
+            LOG_ERROR("BufferArena::mapRegion mmap error:%d \n", errno);
+            throw std::bad_alloc();
+        }
+        uintptr_t aligned = (reinterpret_cast<uintptr_t>(raw) + kRegionSize - 1) & ~(kRegionSize - 1);
+        region = reinterpret_cast<char *>(aligned);
+        if (region > raw)
+        {
+            ::munmap(raw, region - raw);
+        }
+        size_t tail = raw + kRegionSize * 2 - (region + kRegionSize);
+        if (tail > 0)
+        {
+            ::munmap(region + kRegionSize, tail);
+        }
+        ::madvise(region, kRegionSize, MADV_HUGEPAGE);
+        regions_.push_back(std::make_pair(region, kRegionSize));
+    }
+    cursor_ = region;
+    regionEnd_ = region + kRegionSize;
+}
+
+void BufferArena::deallocate(char *data, size_t capacity)
+{
+    if (capacity > kMaxChunkSize)
+    {
+        ::free(data);
+    }
+    else
+    {
+        int index = sizeClass(capacity);
+        FreeChunk *chunk = reinterpret_cast<FreeChunk *>(data);
+        if (isOwnerThread())
+        {
+            chunk->next = localFree_[index];
+            localFree_[index] = chunk;
+        }
+        else
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            chunk->next = remoteFree_[index];
+            remoteFree_[index] = chunk;
+        }
+    }
+    release();
+}
+
+void BufferArena::detach()
+{
+    // 本地链表上的块已经不会再被使用 loop之后析构的连接归还的块都走远端链表
+    detached_.store(true, std::memory_order_relaxed);
+    release();
+}
+
+// 每个没有归还的块和所属loop各持有一个引用 最后一个引用释放时析构
+void BufferArena::release()
+{
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        delete this;
+    }
+}
+
+BufferArena::Stats BufferArena::stats() const
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    Stats s;
+    s.regions = regions_.size();
+    s.hugeRegions = hugeRegions_;
+    s.chunksInUse = refs_.load(std::memory_order_relaxed) - (detached_.load(std::memory_order_relaxed) ? 0 : 1);
+    return s;
+}
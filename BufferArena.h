@@ -0,0 +1,74 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "BufferAllocator.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+
+/*
+每个EventLoop一个的Buffer内存池
+从2MB的大页区域(优先MAP_HUGETLB，失败时退回普通mmap加MADV_HUGEPAGE透明大页)中切出按2的幂分级的内存块，
+归还的块挂到所属loop的空闲链表上，下次分配同级别的块直接复用，不经过malloc，也不会把堆打碎
+所属loop线程分配和归还只操作本线程的空闲链表，不加锁；其他线程归还的块放进加锁的远端链表，loop线程取空本地链表时一次性收回
+超过kMaxChunkSize的请求直接走malloc
+*/
+class BufferArena : public BufferAllocator, noncopyable
+{
+public:
+    static const size_t kRegionSize = 2 * 1024 * 1024;
+    static const size_t kMinChunkSize = 256;
+    static const size_t kMaxChunkSize = 256 * 1024;
+
+    struct Stats
+    {
+        size_t regions;      // 已经映射的区域数
+        size_t hugeRegions;  // 其中使用MAP_HUGETLB的区域数
+        size_t chunksInUse;  // 还没有归还的块(包括超大块)
+    };
+
+    // 在所属loop线程中创建
+    BufferArena();
+
+    char *allocate(size_t size, size_t *capacity) override;
+    void deallocate(char *data, size_t capacity) override;
+    size_t goodSize(size_t size) const override { return size > kMaxChunkSize ? size : classSize(sizeClass(size)); }
+
+    // 所属EventLoop析构时调用 之后最后一个块归还时释放整个内存池 调用后不能再分配
+    void detach();
+
+    Stats stats() const;
+
+private:
+    static const int kNumClasses = 11; // 256B ... 256KB
+
+    struct FreeChunk
+    {
+        FreeChunk *next;
+    };
+
+    ~BufferArena();
+
+    static int sizeClass(size_t size);
+    static size_t classSize(int index) { return kMinChunkSize << index; }
+
+    bool isOwnerThread() const;
+    char *allocateLocked(int index);
+    void mapRegion();
+    void release();
+
+    int ownerTid_;
+    FreeChunk *localFree_[kNumClasses]; // 只在所属loop线程中访问
+
+    mutable std::mutex mutex_;
+    FreeChunk *remoteFree_[kNumClasses]; // 由mutex_保护
+    std::vector<std::pair<char *, size_t>> regions_;
+    size_t hugeRegions_;
+    char *cursor_; // 当前区域中还没有切出去的部分
+    char *regionEnd_;
+
+    std::atomic<size_t> refs_; // 没有归还的块数 所属loop还在时再加一
+    std::atomic_bool detached_;
+};
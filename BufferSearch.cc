@@ -0,0 +1,276 @@
+#include "BufferSearch.h"
+
+#include <string.h>
+#include <stdint.h>
+
+// i386的基线不包含SSE2 只有编译器开启了SSE2(-msse2)时才编译SIMD版本，否则用标量版本
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#include <immintrin.h>
+#define MYMUDUO_X86_SIMD 1
+#endif
+
+namespace
+{
+    // 向量化的findAny最多支持的字节个数，更大的集合使用查表
+    const size_t kMaxSimdSet = 16;
+
+    // ---------------- 标量实现 ----------------
+    const char *findByteScalar(const char *begin, const char *end, char c)
+    {
+        const void *p = ::memchr(begin, c, end - begin);
+        return p ? static_cast<const char *>(p) : end;
+    }
+
+    const char *findCRLFScalar(const char *begin, const char *end)
+    {
+        for (const char *p = begin; p + 1 < end; ++p)
+        {
+            if (p[0] == '\r' && p[1] == '\n')
+            {
+                return p;
+            }
+        }
+        return end;
+    }
+
+    const char *findAnyScalar(const char *begin, const char *end, const char *set, size_t setLen)
+    {
+        bool table[256] = {false};
+        for (size_t i = 0; i < setLen; ++i)
+        {
+            table[static_cast<unsigned char>(set[i])] = true;
+        }
+        for (const char *p = begin; p < end; ++p)
+        {
+            if (table[static_cast<unsigned char>(*p)])
+            {
+                return p;
+            }
+        }
+        return end;
+    }
+
+    void xorMaskScalar(char *data, size_t len, uint32_t key)
+    {
+        const unsigned char *k = reinterpret_cast<const unsigned char *>(&key);
+        for (size_t i = 0; i < len; ++i)
+        {
+            data[i] ^= k[i & 3];
+        }
+    }
+
+#ifdef MYMUDUO_X86_SIMD
+    // ---------------- SSE2 x86-64基线指令集 ----------------
+    const char *findByteSse2(const char *begin, const char *end, char c)
+    {
+        const __m128i needle = _mm_set1_epi8(c);
+        const char *p = begin;
+        for (; p + 16 <= end; p += 16)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+            if (mask)
+            {
+                return p + __builtin_ctz(mask);
+            }
+        }
+        return findByteScalar(p, end, c);
+    }
+
+    const char *findCRLFSse2(const char *begin, const char *end)
+    {
+        const __m128i cr = _mm_set1_epi8('\r');
+        const __m128i lf = _mm_set1_epi8('\n');
+        const char *p = begin;
+        // 同时比较p处的'\r'和p+1处的'\n'，需要多读一个字节
+        for (; p + 17 <= end; p += 16)
+        {
+            __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 1));
+            int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(v0, cr), _mm_cmpeq_epi8(v1, lf)));
+            if (mask)
+            {
+                return p + __builtin_ctz(mask);
+            }
+        }
+        return findCRLFScalar(p, end);
+    }
+
+    const char *findAnySse2(const char *begin, const char *end, const char *set, size_t setLen)
+    {
+        if (setLen == 0 || setLen > kMaxSimdSet)
+        {
+            return findAnyScalar(begin, end, set, setLen);
+        }
+        __m128i needles[kMaxSimdSet];
+        for (size_t i = 0; i < setLen; ++i)
+        {
+            needles[i] = _mm_set1_epi8(set[i]);
+        }
+        const char *p = begin;
+        for (; p + 16 <= end; p += 16)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            __m128i hit = _mm_cmpeq_epi8(v, needles[0]);
+            for (size_t i = 1; i < setLen; ++i)
+            {
+                hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, needles[i]));
+            }
+            int mask = _mm_movemask_epi8(hit);
+            if (mask)
+            {
+                return p + __builtin_ctz(mask);
+            }
+        }
+        return findAnyScalar(p, end, set, setLen);
+    }
+
+    void xorMaskSse2(char *data, size_t len, uint32_t key)
+    {
+        // 掩码4字节一循环，16字节的块里正好重复4次
+        const __m128i mask = _mm_set1_epi32(static_cast<int>(key));
+        size_t i = 0;
+        for (; i + 16 <= len; i += 16)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(data + i), _mm_xor_si128(v, mask));
+        }
+        xorMaskScalar(data + i, len - i, key);
+    }
+
+    // ---------------- AVX2 只为这几个函数开启，运行时检测CPU后才会调用 ----------------
+    __attribute__((target("avx2"))) const char *findByteAvx2(const char *begin, const char *end, char c)
+    {
+        const __m256i needle = _mm256_set1_epi8(c);
+        const char *p = begin;
+        for (; p + 32 <= end; p += 32)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+            unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle)));
+            if (mask)
+            {
+                return p + __builtin_ctz(mask);
+            }
+        }
+        return findByteSse2(p, end, c);
+    }
+
+    __attribute__((target("avx2"))) const char *findCRLFAvx2(const char *begin, const char *end)
+    {
+        const __m256i cr = _mm256_set1_epi8('\r');
+        const __m256i lf = _mm256_set1_epi8('\n');
+        const char *p = begin;
+        for (; p + 33 <= end; p += 32)
+        {
+            __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+            __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 1));
+            unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(v0, cr), _mm256_cmpeq_epi8(v1, lf))));
+            if (mask)
+            {
+                return p + __builtin_ctz(mask);
+            }
+        }
+        return findCRLFSse2(p, end);
+    }
+
+    __attribute__((target("avx2"))) const char *findAnyAvx2(const char *begin, const char *end, const char *set, size_t setLen)
+    {
+        if (setLen == 0 || setLen > kMaxSimdSet)
+        {
+            return findAnyScalar(begin, end, set, setLen);
+        }
+        __m256i needles[kMaxSimdSet];
+        for (size_t i = 0; i < setLen; ++i)
+        {
+            needles[i] = _mm256_set1_epi8(set[i]);
+        }
+        const char *p = begin;
+        for (; p + 32 <= end; p += 32)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+            __m256i hit = _mm256_cmpeq_epi8(v, needles[0]);
+            for (size_t i = 1; i < setLen; ++i)
+            {
+                hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, needles[i]));
+            }
+            unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(hit));
+            if (mask)
+            {
+                return p + __builtin_ctz(mask);
+            }
+        }
+        return findAnySse2(p, end, set, setLen);
+    }
+
+    __attribute__((target("avx2"))) void xorMaskAvx2(char *data, size_t len, uint32_t key)
+    {
+        const __m256i mask = _mm256_set1_epi32(static_cast<int>(key));
+        size_t i = 0;
+        for (; i + 32 <= len; i += 32)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(data + i), _mm256_xor_si256(v, mask));
+        }
+        xorMaskSse2(data + i, len - i, key);
+    }
+#endif
+
+    struct Kernels
+    {
+        const char *(*findByte)(const char *, const char *, char);
+        const char *(*findCRLF)(const char *, const char *);
+        const char *(*findAny)(const char *, const char *, const char *, size_t);
+        void (*xorMask)(char *, size_t, uint32_t);
+        const char *name;
+    };
+
+    // 程序启动时根据CPU选择一次实现
+    Kernels selectKernels()
+    {
+#ifdef MYMUDUO_X86_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return Kernels{findByteAvx2, findCRLFAvx2, findAnyAvx2, xorMaskAvx2, "avx2"};
+        }
+        return Kernels{findByteSse2, findCRLFSse2, findAnySse2, xorMaskSse2, "sse2"};
+#else
+        return Kernels{findByteScalar, findCRLFScalar, findAnyScalar, xorMaskScalar, "scalar"};
+#endif
+    }
+
+    const Kernels &kernels()
+    {
+        static const Kernels k = selectKernels();
+        return k;
+    }
+}
+
+namespace BufferSearch
+{
+    const char *findByte(const char *begin, const char *end, char c)
+    {
+        return kernels().findByte(begin, end, c);
+    }
+
+    const char *findCRLF(const char *begin, const char *end)
+    {
+        return kernels().findCRLF(begin, end);
+    }
+
+    const char *findAny(const char *begin, const char *end, const char *set, size_t setLen)
+    {
+        return kernels().findAny(begin, end, set, setLen);
+    }
+
+    void xorMask(char *data, size_t len, uint32_t key)
+    {
+        kernels().xorMask(data, len, key);
+    }
+
+    const char *implementation()
+    {
+        return kernels().name;
+    }
+}
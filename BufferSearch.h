@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+Buffer使用的查找内核 x86上运行时检测AVX2，否则使用SSE2，其他平台使用标量实现
+查找函数在[begin, end)中查找，找不到返回end
+*/
+namespace BufferSearch
+{
+    // 查找单个字节
+    const char *findByte(const char *begin, const char *end, char c);
+    // 查找"\r\n"，返回'\r'的位置
+    const char *findCRLF(const char *begin, const char *end);
+    // 查找set中任意一个字节
+    const char *findAny(const char *begin, const char *end, const char *set, size_t setLen);
+
+    // 就地异或4字节循环的掩码 data[i] ^= key[i % 4]，key按内存中的字节顺序 用于WebSocket去掩码
+    void xorMask(char *data, size_t len, uint32_t key);
+
+    // 当前使用的实现 "avx2" "sse2" "scalar"
+    const char *implementation();
+}
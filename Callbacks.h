@@ -6,6 +6,8 @@
 class Buffer;
 class TcpConnection;
 class Timestamp;
+class InetAddress;
+class UdpSocket;
 
 using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
 using ConnectionCallback = std::function<void(const TcpConnectionPtr &)>;
@@ -16,4 +18,21 @@ using MessageCallback = std::function<void(const TcpConnectionPtr &,
                                            Buffer *,
                                            Timestamp)>;
 
-using HighWaterMarkCallback = std::function<void(const TcpConnectionPtr &, size_t)>;
\ No newline at end of file
+using HighWaterMarkCallback = std::function<void(const TcpConnectionPtr &, size_t)>;
+
+using TimerCallback = std::function<void()>;
+
+// UDP数据报回调 data指向预分配的接收缓冲区，只在回调期间有效
+using DatagramCallback = std::function<void(UdpSocket *,
+                                            const char *data,
+                                            size_t len,
+                                            const InetAddress &peer,
+                                            Timestamp receiveTime)>;
+
+// UDP_GRO合并后的数据报回调 data由多个segmentSize大小的数据报拼接而成(最后一个可以更短)
+using SegmentedDatagramCallback = std::function<void(UdpSocket *,
+                                                     const char *data,
+                                                     size_t len,
+                                                     size_t segmentSize,
+                                                     const InetAddress &peer,
+                                                     Timestamp receiveTime)>;
\ No newline at end of file
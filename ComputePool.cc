@@ -0,0 +1,280 @@
+#include "ComputePool.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+#include "Logger.h"
+
+namespace
+{
+// 当前线程所属的计算线程池和工作线程下标 工作线程中提交的任务直接放进自己的队列
+thread_local ComputePool *t_currentPool = nullptr;
+thread_local size_t t_workerIndex = 0;
+
+// 计算线程池满时重试的间隔 单位秒
+const double kRetryInterval = 0.001;
+} // namespace
+
+ComputePool::ComputePool(const std::string &nameArg)
+    : name_(nameArg),
+      maxQueueSize_(0),
+      queued_(0),
+      nextWorker_(0),
+      running_(false),
+      sleepers_(0)
+{
+}
+
+ComputePool::~ComputePool()
+{
+    if (running_)
+    {
+        stop();
+    }
+}
+
+void ComputePool::start(int numThreads)
+{
+    running_ = true;
+    workers_.reserve(numThreads);
+    threads_.reserve(numThreads);
+    for (int i = 0; i < numThreads; ++i)
+    {
+        workers_.emplace_back(new Worker);
+    }
+    // 所有队列都建好之后再启动线程 偷任务时会访问其他线程的队列
+    for (int i = 0; i < numThreads; ++i)
+    {
+        threads_.emplace_back(new Thread(std::bind(&ComputePool::runInThread, this, static_cast<size_t>(i)),
+                                         name_ + std::to_string(i)));
+        threads_.back()->start();
+    }
+}
+
+void ComputePool::stop()
+{
+    {
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        running_ = false;
+        wakeup_.notify_all();
+    }
+    for (auto &thr : threads_)
+    {
+        thr->join();
+    }
+    threads_.clear();
+    workers_.clear();
+}
+
+bool ComputePool::trySubmit(Task task)
+{
+    if (workers_.empty())
+    {
+        task();
+        return true;
+    }
+    if (!running_)
+    {
+        return false;
+    }
+
+    size_t queued = queued_.fetch_add(1);
+    if (maxQueueSize_ > 0 && queued >= maxQueueSize_)
+    {
+        queued_.fetch_sub(1);
+        return false;
+    }
+
+    size_t index = t_currentPool == this ? t_workerIndex : nextWorker_.fetch_add(1) % workers_.size();
+    Worker &worker = *workers_[index];
+    {
+        std::unique_lock<std::mutex> lock(worker.mutex);
+        worker.tasks.push_back(std::move(task));
+    }
+
+    // queued_先于sleepers_检查，工作线程在sleepMutex_下先增加sleepers_再检查queued_，不会丢失唤醒
+    if (sleepers_.load() > 0)
+    {
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        wakeup_.notify_one();
+    }
+    return true;
+}
+
+bool ComputePool::take(size_t index, Task *task)
+{
+    size_t n = workers_.size();
+    for (;;)
+    {
+        // 先取自己队列的头部，再依次从其他线程的队列尾部偷
+        for (size_t i = 0; i < n; ++i)
+        {
+            Worker &worker = *workers_[(index + i) % n];
+            std::unique_lock<std::mutex> lock(worker.mutex);
+            if (worker.tasks.empty())
+            {
+                continue;
+            }
+            if (i == 0)
+            {
+                *task = std::move(worker.tasks.front());
+                worker.tasks.pop_front();
+            }
+            else
+            {
+                *task = std::move(worker.tasks.back());
+                worker.tasks.pop_back();
+            }
+            queued_.fetch_sub(1);
+            return true;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        sleepers_.fetch_add(1);
+        while (queued_.load() == 0 && running_)
+        {
+            wakeup_.wait(lock);
+        }
+        sleepers_.fetch_sub(1);
+        if (queued_.load() == 0 && !running_)
+        {
+            // stop之后把已经提交的任务执行完再退出
+            return false;
+        }
+    }
+}
+
+void ComputePool::runInThread(size_t index)
+{
+    t_currentPool = this;
+    t_workerIndex = index;
+    Task task;
+    while (take(index, &task))
+    {
+        task();
+        task = nullptr;
+    }
+    t_currentPool = nullptr;
+}
+
+ComputeSequencer::ComputeSequencer(ComputePool *pool, const TcpConnectionPtr &conn, size_t maxInFlight)
+    : pool_(pool),
+      loop_(conn->getLoop()),
+      conn_(conn),
+      maxInFlight_(maxInFlight > 0 ? maxInFlight : 1),
+      nextSeq_(0),
+      sendSeq_(0),
+      throttled_(false),
+      retryScheduled_(false)
+{
+}
+
+void ComputeSequencer::submit(ComputeTask work)
+{
+    uint64_t seq = nextSeq_++;
+    results_.push_back(std::shared_ptr<Buffer>());
+    // 前面还有没提交出去的任务时直接排队，保证计算线程拿到任务的顺序和请求顺序大致一致
+    if (!backlog_.empty() || !dispatch(seq, work))
+    {
+        Pending pending;
+        pending.seq = seq;
+        pending.work = std::move(work);
+        backlog_.push_back(std::move(pending));
+        if (!retryScheduled_)
+        {
+            std::weak_ptr<ComputeSequencer> weakSelf(shared_from_this());
+            ownerLoop()->runAfter(kRetryInterval, [weakSelf]()
+                                  {
+                                      std::shared_ptr<ComputeSequencer> self = weakSelf.lock();
+                                      if (self)
+                                      {
+                                          self->dispatchBacklog();
+                                      } });
+            retryScheduled_ = true;
+        }
+    }
+    updateThrottle();
+}
+
+bool ComputeSequencer::dispatch(uint64_t seq, const ComputeTask &work)
+{
+    std::shared_ptr<ComputeSequencer> self(shared_from_this());
+    return pool_->trySubmit([self, seq, work]()
+                            {
+                                std::shared_ptr<Buffer> output(new Buffer);
+                                work(output.get());
+                                self->ownerLoop()->runInLoop([self, seq, output]()
+                                                             { self->complete(seq, output); }); });
+}
+
+EventLoop *ComputeSequencer::ownerLoop() const
+{
+    TcpConnectionPtr conn = conn_.lock();
+    return conn ? conn->getLoop() : loop_;
+}
+
+void ComputeSequencer::dispatchBacklog()
+{
+    retryScheduled_ = false;
+    while (!backlog_.empty() && dispatch(backlog_.front().seq, backlog_.front().work))
+    {
+        backlog_.pop_front();
+    }
+    if (!backlog_.empty())
+    {
+        std::weak_ptr<ComputeSequencer> weakSelf(shared_from_this());
+        ownerLoop()->runAfter(kRetryInterval, [weakSelf]()
+                              {
+                                  std::shared_ptr<ComputeSequencer> self = weakSelf.lock();
+                                  if (self)
+                                  {
+                                      self->dispatchBacklog();
+                                  } });
+        retryScheduled_ = true;
+    }
+}
+
+void ComputeSequencer::complete(uint64_t seq, const std::shared_ptr<Buffer> &output)
+{
+    EventLoop *loop = ownerLoop();
+    if (!loop->isInLoopThread())
+    {
+        // 提交之后连接迁移到了其他loop
+        std::shared_ptr<ComputeSequencer> self(shared_from_this());
+        loop->queueInLoop([self, seq, output]()
+                          { self->complete(seq, output); });
+        return;
+    }
+    results_[static_cast<size_t>(seq - sendSeq_)] = output;
+
+    TcpConnectionPtr conn = conn_.lock();
+    while (!results_.empty() && results_.front())
+    {
+        // 连接已经断开时只推进序号 丢弃响应
+        if (conn && conn->connected() && results_.front()->readableBytes() > 0)
+        {
+            conn->send(results_.front().get());
+        }
+        results_.pop_front();
+        ++sendSeq_;
+    }
+    updateThrottle();
+}
+
+void ComputeSequencer::updateThrottle()
+{
+    TcpConnectionPtr conn = conn_.lock();
+    if (!conn)
+    {
+        return;
+    }
+    if (!throttled_ && inFlight() >= maxInFlight_)
+    {
+        LOG_DEBUG("ComputeSequencer %s pause reading, %lu requests in flight \n", conn->name().c_str(), inFlight());
+        conn->throttleRead(true);
+        throttled_ = true;
+    }
+    else if (throttled_ && inFlight() <= maxInFlight_ / 2)
+    {
+        conn->throttleRead(false);
+        throttled_ = false;
+    }
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Thread.h"
+#include "Callbacks.h"
+#include "Buffer.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+class EventLoop;
+
+/*
+计算线程池 和EventLoopThreadPool配合使用，把压缩、加解密、JSON之类的CPU密集任务移出IO线程
+每个工作线程有自己的任务队列，自己的队列空了就从其他线程的队列尾部偷任务，
+IO线程提交的任务轮流分给各个工作线程，工作线程中提交的任务放进自己的队列
+*/
+class ComputePool : noncopyable
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit ComputePool(const std::string &nameArg = std::string("ComputePool"));
+    ~ComputePool();
+
+    // 所有队列中等待执行的任务总数上限 0表示不限制 必须在start之前设置
+    void setMaxQueueSize(size_t maxSize) { maxQueueSize_ = maxSize; }
+    void start(int numThreads);
+    void stop();
+
+    // 队列满时立即返回false 可以在任意线程调用 没有工作线程时直接在调用线程中执行
+    bool trySubmit(Task task);
+
+    const std::string &name() const { return name_; }
+    size_t queueSize() const { return queued_.load(); }
+    int numThreads() const { return static_cast<int>(workers_.size()); }
+
+private:
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks; // 由mutex保护 自己从头部取 其他线程从尾部偷
+    };
+
+    void runInThread(size_t index);
+    bool take(size_t index, Task *task);
+
+    std::string name_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::unique_ptr<Thread>> threads_;
+    size_t maxQueueSize_;
+    std::atomic<size_t> queued_;
+    std::atomic<size_t> nextWorker_;
+    std::atomic_bool running_;
+
+    std::mutex sleepMutex_;
+    std::condition_variable wakeup_;
+    std::atomic_int sleepers_;
+};
+
+/*
+每个连接一个 保证流水线请求的响应按请求顺序发送
+计算任务在ComputePool中执行，结果写入各自的Buffer，完成后通过runInLoop回到连接所在的loop，
+前面的请求都完成后按序号依次发送
+在途任务达到maxInFlight时暂停连接的读取，降到一半以下后恢复，把计算线程池的压力反压到读路径上
+*/
+class ComputeSequencer : noncopyable, public std::enable_shared_from_this<ComputeSequencer>
+{
+public:
+    // 在计算线程中执行 写入output的数据就是这个请求的响应
+    using ComputeTask = std::function<void(Buffer *output)>;
+
+    ComputeSequencer(ComputePool *pool, const TcpConnectionPtr &conn, size_t maxInFlight = 64);
+
+    // 只能在连接所在的loop线程中调用 一般在onMessage中调用，work需要自己拷贝请求数据
+    void submit(ComputeTask work);
+    // 已提交但响应还没有发送的请求数
+    size_t inFlight() const { return static_cast<size_t>(nextSeq_ - sendSeq_); }
+
+private:
+    struct Pending
+    {
+        uint64_t seq;
+        ComputeTask work;
+    };
+
+    bool dispatch(uint64_t seq, const ComputeTask &work);
+    void dispatchBacklog();
+    void complete(uint64_t seq, const std::shared_ptr<Buffer> &output);
+    void updateThrottle();
+    // 连接迁移后返回新的loop 连接已经销毁时返回创建时的loop
+    EventLoop *ownerLoop() const;
+
+    ComputePool *pool_;
+    EventLoop *loop_;
+    std::weak_ptr<TcpConnection> conn_; // 构造后不再修改 计算线程也会读取
+    size_t maxInFlight_;
+    uint64_t nextSeq_; // 下一个提交的请求序号
+    uint64_t sendSeq_; // 下一个要发送响应的请求序号
+    std::deque<std::shared_ptr<Buffer>> results_; // 下标为seq - sendSeq_ 为空表示还没有完成
+    std::deque<Pending> backlog_;                 // 计算线程池队列满时暂存，定时重试
+    bool throttled_;
+    bool retryScheduled_;
+};
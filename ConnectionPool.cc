@@ -0,0 +1,358 @@
+#include "ConnectionPool.h"
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <algorithm>
+
+ConnectionPool::ConnectionPool(EventLoop *loop, const InetAddress &backend, const std::string &name,
+                               const ResponseFramer &framer, const Options &options)
+    : loop_(loop),
+      backend_(backend),
+      name_(name),
+      framer_(framer),
+      options_(options),
+      nextId_(1)
+{
+    checkTimer_ = loop_->runEvery(options_.checkInterval, std::bind(&ConnectionPool::checkHealth, this));
+}
+
+ConnectionPool::~ConnectionPool()
+{
+    loop_->cancel(checkTimer_);
+    for (const Request &req : waiting_)
+    {
+        req.cb(false, nullptr, 0);
+    }
+    waiting_.clear();
+
+    for (const PooledConnectionPtr &pc : conns_)
+    {
+        if (pc->conn)
+        {
+            // 连接上的回调指向即将析构的连接池，先解除
+            pc->conn->setConnectionCallback([](const TcpConnectionPtr &) {});
+            pc->conn->setMessageCallback([](const TcpConnectionPtr &, Buffer *, Timestamp) {});
+            pc->conn.reset();
+        }
+        for (const Request &req : pc->inflight)
+        {
+            req.cb(false, nullptr, 0);
+        }
+        pc->inflight.clear();
+        pc->client.reset(); // TcpClient析构会关闭连接或停止重连
+    }
+}
+
+size_t ConnectionPool::idleConnections() const
+{
+    size_t idle = 0;
+    for (const PooledConnectionPtr &pc : conns_)
+    {
+        if (pc->conn && pc->inflight.empty())
+        {
+            ++idle;
+        }
+    }
+    return idle;
+}
+
+void ConnectionPool::request(const std::string &payload, const ResponseCallback &cb)
+{
+    if (waiting_.size() >= options_.maxWaiting)
+    {
+        LOG_ERROR("ConnectionPool[%s] too many waiting requests:%lu \n", name_.c_str(), waiting_.size());
+        cb(false, nullptr, 0);
+        return;
+    }
+
+    Request req;
+    req.payload = payload;
+    req.cb = cb;
+    req.sendTime = Timestamp::now();
+    waiting_.push_back(std::move(req));
+    dispatchWaiting();
+}
+
+ConnectionPool::PooledConnection *ConnectionPool::newConnection()
+{
+    char buf[32] = {0};
+    snprintf(buf, sizeof buf, "-pool#%d", nextId_);
+    ++nextId_;
+
+    PooledConnectionPtr pc(new PooledConnection);
+    pc->client.reset(new TcpClient(loop_, backend_, name_ + buf));
+    pc->client->setConnectionCallback(std::bind(&ConnectionPool::onConnection, this, pc.get(),
+                                                std::placeholders::_1));
+    pc->client->setMessageCallback(std::bind(&ConnectionPool::onMessage, this, pc.get(),
+                                             std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    pc->lastActive = loop_->now();
+    conns_.push_back(pc);
+    pc->client->connect();
+    return pc.get();
+}
+
+// 选择已连接且在途请求最少的连接，流水线已满返回nullptr
+ConnectionPool::PooledConnection *ConnectionPool::pickConnection()
+{
+    PooledConnection *best = nullptr;
+    for (const PooledConnectionPtr &pc : conns_)
+    {
+        if (pc->conn && pc->conn->connected() && static_cast<int>(pc->inflight.size()) < options_.maxPipeline)
+        {
+            if (best == nullptr || pc->inflight.size() < best->inflight.size())
+            {
+                best = pc.get();
+            }
+        }
+    }
+    return best;
+}
+
+void ConnectionPool::sendOn(PooledConnection *pc, Request req)
+{
+    pc->conn->send(req.payload);
+    std::string().swap(req.payload); // 已经写入连接，不再需要保留
+    req.sendTime = Timestamp::now();
+    pc->lastActive = req.sendTime;
+    pc->inflight.push_back(std::move(req));
+}
+
+void ConnectionPool::dispatchWaiting()
+{
+    while (!waiting_.empty())
+    {
+        PooledConnection *pc = pickConnection();
+        if (pc == nullptr)
+        {
+            break;
+        }
+        Request req = std::move(waiting_.front());
+        waiting_.pop_front();
+        sendOn(pc, std::move(req));
+    }
+
+    if (!waiting_.empty())
+    {
+        // 正在建立的连接不足以承载排队的请求时才新建连接
+        size_t connecting = 0;
+        for (const PooledConnectionPtr &pc : conns_)
+        {
+            if (!pc->conn)
+            {
+                ++connecting;
+            }
+        }
+        if (waiting_.size() > connecting * options_.maxPipeline &&
+            static_cast<int>(conns_.size()) < options_.maxTotal)
+        {
+            newConnection();
+        }
+    }
+}
+
+void ConnectionPool::onConnection(PooledConnection *pc, const TcpConnectionPtr &conn)
+{
+    if (conn->connected())
+    {
+        LOG_INFO("ConnectionPool[%s] connection %s up \n", name_.c_str(), conn->name().c_str());
+        pc->conn = conn;
+        pc->lastActive = loop_->now();
+        dispatchWaiting();
+    }
+    else
+    {
+        LOG_INFO("ConnectionPool[%s] connection %s down \n", name_.c_str(), conn->name().c_str());
+        pc->conn.reset();
+        failAll(pc);
+        releaseConnection(pc);
+        dispatchWaiting();
+    }
+}
+
+void ConnectionPool::onMessage(PooledConnection *pc, const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+{
+    while (buf->readableBytes() > 0)
+    {
+        ssize_t len = framer_(buf);
+        if (len == 0)
+        {
+            break; // 响应还不完整
+        }
+        if (len < 0 || pc->inflight.empty())
+        {
+            LOG_ERROR("ConnectionPool[%s] bad response on %s, evict \n", name_.c_str(), conn->name().c_str());
+            buf->retrieveAll();
+            evict(pc);
+            return;
+        }
+
+        Request req = std::move(pc->inflight.front());
+        pc->inflight.pop_front();
+        pc->lastActive = receiveTime;
+        // 响应直接指向输入缓冲区，回调返回后再回收
+        req.cb(true, buf->peek(), static_cast<size_t>(len));
+        buf->retrieve(static_cast<size_t>(len));
+    }
+    dispatchWaiting();
+}
+
+void ConnectionPool::evict(PooledConnection *pc)
+{
+    if (pc->conn)
+    {
+        pc->conn->forceClose(); // 关闭后onConnection负责失败在途请求并回收
+    }
+}
+
+void ConnectionPool::failAll(PooledConnection *pc)
+{
+    std::deque<Request> inflight;
+    inflight.swap(pc->inflight);
+    for (const Request &req : inflight)
+    {
+        req.cb(false, nullptr, 0);
+    }
+}
+
+void ConnectionPool::releaseConnection(PooledConnection *pc)
+{
+    for (auto it = conns_.begin(); it != conns_.end(); ++it)
+    {
+        if (it->get() == pc)
+        {
+            PooledConnectionPtr holder(*it);
+            conns_.erase(it);
+            // 当前处于TcpClient的回调中，延后析构TcpClient
+            loop_->queueInLoop([holder]()
+                               { holder->client.reset(); });
+            break;
+        }
+    }
+}
+
+void ConnectionPool::checkHealth()
+{
+    Timestamp now(loop_->now());
+
+    // 排队超时的请求直接失败
+    while (!waiting_.empty() && timeDifference(now, waiting_.front().sendTime) > options_.requestTimeout)
+    {
+        Request req = std::move(waiting_.front());
+        waiting_.pop_front();
+        req.cb(false, nullptr, 0);
+    }
+
+    std::vector<PooledConnection *> idle;
+    std::vector<PooledConnectionPtr> conns(conns_);
+    bool evictedConnecting = false;
+    for (const PooledConnectionPtr &pc : conns)
+    {
+        if (!pc->conn)
+        {
+            // 后端不可达时TcpClient会一直重连 超时后放弃，让出maxTotal的名额
+            if (timeDifference(now, pc->lastActive) > options_.connectTimeout)
+            {
+                LOG_ERROR("ConnectionPool[%s] connect timeout, evict \n", name_.c_str());
+                pc->client->stop(); // 停止重连 之后即使连上也不会再回调到这个连接
+                releaseConnection(pc.get());
+                evictedConnecting = true;
+            }
+            continue;
+        }
+        if (!pc->inflight.empty())
+        {
+            // 最早的请求超时没有响应，判定连接不健康
+            if (timeDifference(now, pc->inflight.front().sendTime) > options_.requestTimeout)
+            {
+                LOG_ERROR("ConnectionPool[%s] request timeout on %s, evict \n", name_.c_str(), pc->conn->name().c_str());
+                evict(pc.get());
+            }
+        }
+        else
+        {
+            idle.push_back(pc.get());
+        }
+    }
+
+    // 空闲连接超过maxIdle时关闭最久未使用的
+    if (static_cast<int>(idle.size()) > options_.maxIdle)
+    {
+        std::sort(idle.begin(), idle.end(), [](PooledConnection *a, PooledConnection *b)
+                  { return a->lastActive < b->lastActive; });
+        size_t excess = idle.size() - options_.maxIdle;
+        for (size_t i = 0; i < excess; ++i)
+        {
+            idle[i]->conn->shutdown();
+        }
+        idle.erase(idle.begin(), idle.begin() + excess);
+    }
+
+    // 对保留下来的空闲连接发送探测请求，超时未响应会在下一轮被驱逐
+    if (!options_.healthProbe.empty())
+    {
+        for (PooledConnection *pc : idle)
+        {
+            if (timeDifference(now, pc->lastActive) >= options_.checkInterval)
+            {
+                Request req;
+                req.payload = options_.healthProbe;
+                req.cb = [](bool, const char *, size_t) {};
+                sendOn(pc, std::move(req));
+            }
+        }
+    }
+
+    if (evictedConnecting)
+    {
+        dispatchWaiting(); // 还有排队的请求时重新建立连接
+    }
+}
+
+ConnectionPoolGroup::ConnectionPoolGroup(const InetAddress &backend, const std::string &name,
+                                         const ConnectionPool::ResponseFramer &framer,
+                                         const ConnectionPool::Options &options)
+    : backend_(backend),
+      name_(name),
+      framer_(framer),
+      options_(options),
+      frozen_(false)
+{
+}
+
+ConnectionPoolGroup::~ConnectionPoolGroup()
+{
+    // 连接池只能在自己的loop线程中析构
+    for (auto &item : pools_)
+    {
+        ConnectionPool *pool = item.second.release();
+        item.first->runInLoop([pool]()
+                              { delete pool; });
+    }
+}
+
+void ConnectionPoolGroup::addLoop(EventLoop *loop)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (frozen_.load(std::memory_order_relaxed))
+    {
+        LOG_FATAL("ConnectionPoolGroup[%s] addLoop after poolOf \n", name_.c_str());
+    }
+    if (pools_.find(loop) == pools_.end())
+    {
+        char buf[32] = {0};
+        snprintf(buf, sizeof buf, "-%lu", pools_.size());
+        pools_[loop].reset(new ConnectionPool(loop, backend_, name_ + buf, framer_, options_));
+    }
+}
+
+ConnectionPool *ConnectionPoolGroup::poolOf(EventLoop *loop) const
+{
+    // 只在第一次调用时写 之后都是读，不会在各loop之间争抢缓存行
+    if (!frozen_.load(std::memory_order_relaxed))
+    {
+        frozen_.store(true, std::memory_order_relaxed);
+    }
+    auto it = pools_.find(loop);
+    return it == pools_.end() ? nullptr : it->second.get();
+}
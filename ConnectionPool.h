@@ -0,0 +1,139 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "Callbacks.h"
+#include "Timestamp.h"
+#include "TimerId.h"
+
+#include <functional>
+#include <string>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <sys/types.h>
+
+class EventLoop;
+class TcpClient;
+
+/*
+上游连接池 每个EventLoop一个实例，只在所属loop线程中使用，不需要加锁
+同一个连接上可以流水线发送多个请求，响应按FIFO顺序和请求匹配
+*/
+class ConnectionPool : noncopyable
+{
+public:
+    // ok为false表示连接断开或请求超时，此时data为空
+    using ResponseCallback = std::function<void(bool ok, const char *data, size_t len)>;
+    // 返回Buffer头部一个完整响应的长度，不完整返回0，协议错误返回-1
+    using ResponseFramer = std::function<ssize_t(const Buffer *)>;
+
+    struct Options
+    {
+        Options()
+            : maxTotal(8),
+              maxIdle(2),
+              maxPipeline(16),
+              maxWaiting(1024),
+              requestTimeout(5.0),
+              connectTimeout(3.0),
+              checkInterval(1.0)
+        {
+        }
+
+        int maxTotal;            // 每个后端最多的连接数
+        int maxIdle;             // 最多保留的空闲连接数
+        int maxPipeline;         // 每个连接上最多在途的请求数
+        size_t maxWaiting;       // 没有可用连接时最多排队的请求数
+        double requestTimeout;   // 请求超时(秒)，超时的连接被判定为不健康并驱逐
+        double connectTimeout;   // 建立连接的超时(秒)，超时还没连上的连接被驱逐，不再占用maxTotal
+        double checkInterval;    // 健康检查间隔(秒)
+        std::string healthProbe; // 非空时定期在空闲连接上发送该探测请求
+    };
+
+    ConnectionPool(EventLoop *loop, const InetAddress &backend, const std::string &name,
+                   const ResponseFramer &framer, const Options &options = Options());
+    ~ConnectionPool();
+
+    // 只能在loop线程中调用
+    void request(const std::string &payload, const ResponseCallback &cb);
+
+    EventLoop *getLoop() const { return loop_; }
+    const InetAddress &backend() const { return backend_; }
+    size_t totalConnections() const { return conns_.size(); }
+    size_t idleConnections() const;
+    size_t waitingRequests() const { return waiting_.size(); }
+
+private:
+    struct Request
+    {
+        std::string payload;
+        ResponseCallback cb;
+        Timestamp sendTime;
+    };
+
+    struct PooledConnection
+    {
+        std::unique_ptr<TcpClient> client;
+        TcpConnectionPtr conn; // 连接建立后有效
+        std::deque<Request> inflight;
+        Timestamp lastActive; // 连接建立前是开始连接的时间
+    };
+
+    using PooledConnectionPtr = std::shared_ptr<PooledConnection>;
+
+    void onConnection(PooledConnection *pc, const TcpConnectionPtr &conn);
+    void onMessage(PooledConnection *pc, const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+    PooledConnection *newConnection();
+    PooledConnection *pickConnection();
+    void sendOn(PooledConnection *pc, Request req);
+    void dispatchWaiting();
+    void evict(PooledConnection *pc);
+    void failAll(PooledConnection *pc);
+    void releaseConnection(PooledConnection *pc);
+    void checkHealth();
+
+    EventLoop *loop_;
+    const InetAddress backend_;
+    const std::string name_;
+    ResponseFramer framer_;
+    Options options_;
+    int nextId_;
+    std::vector<PooledConnectionPtr> conns_;
+    std::deque<Request> waiting_;
+    TimerId checkTimer_;
+};
+
+/*
+为一个后端在每个loop上各建一个ConnectionPool
+在TcpServer::setThreadInitCallback中对每个subloop调用addLoop，
+之后handler通过conn->getLoop()取到本loop的连接池，不会跨线程
+EventLoopThreadPool::start返回之前所有ThreadInitCallback都已执行完，
+此后pools_只读，poolOf不需要加锁
+*/
+class ConnectionPoolGroup : noncopyable
+{
+public:
+    ConnectionPoolGroup(const InetAddress &backend, const std::string &name,
+                        const ConnectionPool::ResponseFramer &framer,
+                        const ConnectionPool::Options &options = ConnectionPool::Options());
+    ~ConnectionPoolGroup();
+
+    // 在任何loop开始处理请求之前调用，第一次poolOf之后不能再注册
+    void addLoop(EventLoop *loop);
+    // 返回loop对应的连接池，loop未注册时返回nullptr 不加锁
+    ConnectionPool *poolOf(EventLoop *loop) const;
+
+private:
+    const InetAddress backend_;
+    const std::string name_;
+    ConnectionPool::ResponseFramer framer_;
+    ConnectionPool::Options options_;
+    std::mutex mutex_; // 只保护addLoop 各subloop的ThreadInitCallback在不同线程中执行
+    mutable std::atomic_bool frozen_;
+    std::unordered_map<EventLoop *, std::unique_ptr<ConnectionPool>> pools_;
+};
@@ -0,0 +1,240 @@
+#include "Connector.h"
+#include "Channel.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <sys/socket.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <algorithm>
+
+static int createNonblockingSocket(sa_family_t family)
+{
+    int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sockfd < 0)
+    {
+        LOG_FATAL("%s:%s:%d connect socket create err: %d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return sockfd;
+}
+
+static int getSocketError(int sockfd)
+{
+    int optval;
+    socklen_t optlen = sizeof optval;
+    if (::getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    {
+        return errno;
+    }
+    return optval;
+}
+
+// 本地端口和对端端口相同时，内核会把连接接到自己身上(自连接)，需要断开重连
+static bool isSelfConnect(int sockfd)
+{
+    InetAddress localaddr = InetAddress::localAddressOf(sockfd);
+    if (localaddr.isUnixDomain())
+    {
+        return false;
+    }
+    return localaddr == InetAddress::peerAddressOf(sockfd);
+}
+
+const int Connector::kMaxRetryDelayMs;
+const int Connector::kInitRetryDelayMs;
+
+Connector::Connector(EventLoop *loop, const InetAddress &serverAddr)
+    : loop_(loop),
+      serverAddr_(serverAddr),
+      connect_(false),
+      state_(kDisconnected),
+      retryDelayMs_(kInitRetryDelayMs)
+{
+    LOG_DEBUG("Connector ctor[%p]\n", this);
+}
+
+Connector::~Connector()
+{
+    LOG_DEBUG("Connector dtor[%p]\n", this);
+}
+
+void Connector::start()
+{
+    connect_ = true;
+    loop_->runInLoop(std::bind(&Connector::startInLoop, shared_from_this()));
+}
+
+void Connector::startInLoop()
+{
+    if (connect_)
+    {
+        connect();
+    }
+    else
+    {
+        LOG_DEBUG("do not connect\n");
+    }
+}
+
+void Connector::stop()
+{
+    connect_ = false;
+    loop_->queueInLoop(std::bind(&Connector::stopInLoop, shared_from_this()));
+    loop_->cancel(retryTimer_);
+}
+
+void Connector::stopInLoop()
+{
+    if (state_ == kConnecting)
+    {
+        setState(kDisconnected);
+        int sockfd = removeAndResetChannel();
+        retry(sockfd);
+    }
+}
+
+void Connector::connect()
+{
+    int sockfd = createNonblockingSocket(serverAddr_.family());
+    int ret = ::connect(sockfd, serverAddr_.getSockAddr(), serverAddr_.getSockLen());
+    int savedErrno = (ret == 0) ? 0 : errno;
+    switch (savedErrno)
+    {
+    case 0:
+    case EINPROGRESS: // 非阻塞connect正在进行中
+    case EINTR:
+    case EISCONN:
+        connecting(sockfd);
+        break;
+
+    case EAGAIN: // 本地临时端口耗尽等，可以稍后重试
+    case EADDRINUSE:
+    case EADDRNOTAVAIL:
+    case ECONNREFUSED:
+    case ENETUNREACH:
+    case ENOENT: // Unix域socket文件还不存在，服务端可能还没有启动
+        retry(sockfd);
+        break;
+
+    case EACCES:
+    case EPERM:
+    case EAFNOSUPPORT:
+    case EALREADY:
+    case EBADF:
+    case EFAULT:
+    case ENOTSOCK:
+        LOG_ERROR("connect error in Connector::startInLoop %d \n", savedErrno);
+        ::close(sockfd);
+        break;
+
+    default:
+        LOG_ERROR("Unexpected error in Connector::startInLoop %d \n", savedErrno);
+        ::close(sockfd);
+        break;
+    }
+}
+
+void Connector::restart()
+{
+    setState(kDisconnected);
+    retryDelayMs_ = kInitRetryDelayMs;
+    connect_ = true;
+    startInLoop();
+}
+
+void Connector::connecting(int sockfd)
+{
+    setState(kConnecting);
+    // 连接建立或失败时sockfd都会变为可写，在handleWrite中通过SO_ERROR区分
+    channel_.reset(new Channel(loop_, sockfd));
+    channel_->setWriteCallback(std::bind(&Connector::handleWrite, this));
+    channel_->setErrorCallback(std::bind(&Connector::handleError, this));
+    channel_->enableWriting();
+}
+
+int Connector::removeAndResetChannel()
+{
+    channel_->disableAll();
+    channel_->remove();
+    int sockfd = channel_->fd();
+    // 当前正处于Channel::handleEvent中，不能直接释放channel_
+    loop_->queueInLoop(std::bind(&Connector::resetChannel, shared_from_this()));
+    return sockfd;
+}
+
+void Connector::resetChannel()
+{
+    channel_.reset();
+}
+
+void Connector::handleWrite()
+{
+    LOG_DEBUG("Connector::handleWrite state=%d\n", (int)state_);
+    if (state_ == kConnecting)
+    {
+        int sockfd = removeAndResetChannel();
+        int err = getSocketError(sockfd);
+        if (err)
+        {
+            LOG_ERROR("Connector::handleWrite - SO_ERROR = %d %s \n", err, strerror(err));
+            retry(sockfd);
+        }
+        else if (isSelfConnect(sockfd))
+        {
+            LOG_ERROR("Connector::handleWrite - Self connect \n");
+            retry(sockfd);
+        }
+        else
+        {
+            setState(kConnected);
+            retryDelayMs_ = kInitRetryDelayMs;
+            if (connect_ && newConnectionCallback_)
+            {
+                newConnectionCallback_(sockfd);
+            }
+            else
+            {
+                ::close(sockfd);
+            }
+        }
+    }
+}
+
+void Connector::handleError()
+{
+    LOG_ERROR("Connector::handleError state=%d \n", (int)state_);
+    if (state_ == kConnecting)
+    {
+        int sockfd = removeAndResetChannel();
+        int err = getSocketError(sockfd);
+        LOG_ERROR("SO_ERROR = %d %s \n", err, strerror(err));
+        retry(sockfd);
+    }
+}
+
+// 关闭当前sockfd，按指数退避的间隔重新发起连接
+void Connector::retry(int sockfd)
+{
+    ::close(sockfd);
+    setState(kDisconnected);
+    if (connect_)
+    {
+        LOG_INFO("Connector::retry - Retry connecting to %s in %d milliseconds. \n",
+                 serverAddr_.toIpPort().c_str(), retryDelayMs_);
+        // 定时器回调持有weak_ptr，Connector析构后不再重连
+        std::weak_ptr<Connector> weakSelf(shared_from_this());
+        retryTimer_ = loop_->runAfter(retryDelayMs_ / 1000.0, [weakSelf]()
+                                      {
+                                          std::shared_ptr<Connector> self = weakSelf.lock();
+                                          if (self)
+                                          {
+                                              self->startInLoop();
+                                          } });
+        retryDelayMs_ = std::min(retryDelayMs_ * 2, kMaxRetryDelayMs);
+    }
+    else
+    {
+        LOG_DEBUG("do not connect\n");
+    }
+}
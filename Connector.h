@@ -0,0 +1,63 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "TimerId.h"
+
+#include <functional>
+#include <memory>
+#include <atomic>
+
+class Channel;
+class EventLoop;
+
+/*
+Connector负责主动发起连接 非阻塞connect + EPOLLOUT可写事件判断连接是否建立
+连接失败时按指数退避重试，连接成功后把sockfd交给TcpClient创建TcpConnection
+*/
+class Connector : noncopyable, public std::enable_shared_from_this<Connector>
+{
+public:
+    using NewConnectionCallback = std::function<void(int sockfd)>;
+
+    Connector(EventLoop *loop, const InetAddress &serverAddr);
+    ~Connector();
+
+    void setNewConnectionCallback(const NewConnectionCallback &cb) { newConnectionCallback_ = cb; }
+
+    void start();   // 可以在任意线程中调用
+    void restart(); // 只能在loop线程中调用
+    void stop();    // 可以在任意线程中调用
+
+    const InetAddress &serverAddress() const { return serverAddr_; }
+
+private:
+    enum States
+    {
+        kDisconnected,
+        kConnecting,
+        kConnected
+    };
+    static const int kMaxRetryDelayMs = 30 * 1000; // 最大重试间隔30s
+    static const int kInitRetryDelayMs = 500;      // 初始重试间隔0.5s
+
+    void setState(States s) { state_ = s; }
+    void startInLoop();
+    void stopInLoop();
+    void connect();
+    void connecting(int sockfd);
+    void handleWrite();
+    void handleError();
+    void retry(int sockfd);
+    int removeAndResetChannel();
+    void resetChannel();
+
+    EventLoop *loop_;
+    InetAddress serverAddr_;
+    std::atomic_bool connect_; // 用户是否希望连接
+    std::atomic_int state_;
+    std::unique_ptr<Channel> channel_; // 只在connect进行中存在
+    NewConnectionCallback newConnectionCallback_;
+    int retryDelayMs_;
+    TimerId retryTimer_;
+};
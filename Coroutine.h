@@ -0,0 +1,471 @@
+#pragma once
+
+/*
+可选的C++20协程接口 库本身仍按C++11编译，只有用-std=c++20编译的用户代码才能看到这里的内容
+    CoTask<T>       可以co_await的协程任务，coSpawn启动一个脱离调用方独立运行的任务
+    coSleep         co_await coSleep(loop, 0.5) 由定时器直接恢复
+    coPost          co_await coPost(loop) 切换到另一个EventLoop的线程继续执行
+    CoConnection    co_await conn.read(n) / readUntil("\r\n") / write(data)
+读操作在TcpConnection::handleRead的消息回调中直接恢复协程，不会再经过一次queueInLoop
+协程帧从当前线程(也就是当前loop)的空闲链表中分配
+*/
+
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine)
+
+#include "noncopyable.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+#include "Buffer.h"
+#include "Logger.h"
+
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <string>
+#include <utility>
+#include <new>
+#include <string.h>
+
+/*
+协程帧分配器 按64字节分级的线程局部空闲链表
+每个EventLoop独占一个线程，所以这就是per-loop的分配器；释放时放回释放线程的链表，
+协程通过coPost换了loop之后，帧的内存就归新loop复用
+*/
+class CoFrameAllocator
+{
+public:
+    static void *allocate(size_t size)
+    {
+        size_t cls = sizeClass(size);
+        if (cls >= kNumClasses)
+        {
+            return ::operator new(size);
+        }
+        FreeNode *&head = freeLists()[cls];
+        if (head)
+        {
+            FreeNode *node = head;
+            head = node->next;
+            return node;
+        }
+        return ::operator new((cls + 1) * kGranularity);
+    }
+
+    static void deallocate(void *p, size_t size)
+    {
+        size_t cls = sizeClass(size);
+        if (cls >= kNumClasses)
+        {
+            ::operator delete(p);
+            return;
+        }
+        FreeNode *node = static_cast<FreeNode *>(p);
+        FreeNode *&head = freeLists()[cls];
+        node->next = head;
+        head = node;
+    }
+
+private:
+    struct FreeNode
+    {
+        FreeNode *next;
+    };
+
+    static const size_t kGranularity = 64;
+    static const size_t kNumClasses = 64; // 4KB以上的帧直接走operator new
+
+    static size_t sizeClass(size_t size) { return (size + kGranularity - 1) / kGranularity - 1; }
+
+    struct FreeLists
+    {
+        FreeNode *heads[kNumClasses] = {};
+        ~FreeLists()
+        {
+            for (FreeNode *head : heads)
+            {
+                while (head)
+                {
+                    FreeNode *next = head->next;
+                    ::operator delete(head);
+                    head = next;
+                }
+            }
+        }
+    };
+
+    static FreeNode **freeLists()
+    {
+        static thread_local FreeLists lists;
+        return lists.heads;
+    }
+};
+
+template <typename T = void>
+class CoTask;
+
+namespace detail
+{
+struct CoPromiseBase
+{
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+    bool detached = false;
+
+    static void *operator new(size_t size) { return CoFrameAllocator::allocate(size); }
+    static void operator delete(void *p, size_t size) { CoFrameAllocator::deallocate(p, size); }
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    // 结束时直接切回等待者 脱离的任务自己销毁帧
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept { return false; }
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept
+        {
+            CoPromiseBase &promise = h.promise();
+            if (promise.detached)
+            {
+                h.destroy();
+                return std::noop_coroutine();
+            }
+            return promise.continuation ? promise.continuation : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception()
+    {
+        if (detached)
+        {
+            // 没有人等待结果 记录日志后正常走到final_suspend，由FinalAwaiter销毁帧
+            // 不能抛回恢复它的事件回调，那里没有人捕获
+            try
+            {
+                throw;
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR("coSpawn task terminated by exception: %s \n", e.what());
+            }
+            catch (...)
+            {
+                LOG_ERROR("coSpawn task terminated by unknown exception \n");
+            }
+            return;
+        }
+        exception = std::current_exception();
+    }
+};
+
+template <typename T>
+struct CoPromise : CoPromiseBase
+{
+    T value;
+    CoTask<T> get_return_object();
+    void return_value(T v) { value = std::move(v); }
+    T result()
+    {
+        if (exception)
+        {
+            std::rethrow_exception(exception);
+        }
+        return std::move(value);
+    }
+};
+
+template <>
+struct CoPromise<void> : CoPromiseBase
+{
+    CoTask<void> get_return_object();
+    void return_void() {}
+    void result()
+    {
+        if (exception)
+        {
+            std::rethrow_exception(exception);
+        }
+    }
+};
+} // namespace detail
+
+// 惰性启动的协程任务 被co_await时才开始执行，结束时直接恢复等待者
+template <typename T>
+class CoTask : noncopyable
+{
+public:
+    using promise_type = detail::CoPromise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    explicit CoTask(Handle h) : handle_(h) {}
+    CoTask(CoTask &&other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    ~CoTask()
+    {
+        if (handle_)
+        {
+            handle_.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        handle_.promise().continuation = awaiting;
+        return handle_;
+    }
+    T await_resume() { return handle_.promise().result(); }
+
+    // 交给coSpawn后由协程自己管理帧的生命周期
+    Handle release() { return std::exchange(handle_, nullptr); }
+
+private:
+    Handle handle_;
+};
+
+namespace detail
+{
+template <typename T>
+CoTask<T> CoPromise<T>::get_return_object()
+{
+    return CoTask<T>(std::coroutine_handle<CoPromise<T>>::from_promise(*this));
+}
+
+inline CoTask<void> CoPromise<void>::get_return_object()
+{
+    return CoTask<void>(std::coroutine_handle<CoPromise<void>>::from_promise(*this));
+}
+} // namespace detail
+
+// 在当前线程中立即开始执行task，执行结束后自动销毁
+inline void coSpawn(CoTask<void> task)
+{
+    CoTask<void>::Handle h = task.release();
+    h.promise().detached = true;
+    h.resume();
+}
+
+// co_await coSleep(loop, seconds) 只能在loop线程中使用
+class CoSleepAwaiter
+{
+public:
+    CoSleepAwaiter(EventLoop *loop, double seconds) : loop_(loop), seconds_(seconds) {}
+
+    bool await_ready() const noexcept { return seconds_ <= 0; }
+    void await_suspend(std::coroutine_handle<> h)
+    {
+        loop_->runAfter(seconds_, [h]()
+                        { h.resume(); });
+    }
+    void await_resume() const noexcept {}
+
+private:
+    EventLoop *loop_;
+    double seconds_;
+};
+
+inline CoSleepAwaiter coSleep(EventLoop *loop, double seconds) { return CoSleepAwaiter(loop, seconds); }
+
+// co_await coPost(loop) 之后的代码在loop线程中执行 已经在loop线程中时不挂起
+class CoPostAwaiter
+{
+public:
+    explicit CoPostAwaiter(EventLoop *loop) : loop_(loop) {}
+
+    bool await_ready() const { return loop_->isInLoopThread(); }
+    void await_suspend(std::coroutine_handle<> h)
+    {
+        loop_->queueInLoop([h]()
+                           { h.resume(); });
+    }
+    void await_resume() const noexcept {}
+
+private:
+    EventLoop *loop_;
+};
+
+inline CoPostAwaiter coPost(EventLoop *loop) { return CoPostAwaiter(loop); }
+
+/*
+协程方式读写一个TcpConnection 在连接建立的回调中构造
+会接管这个连接的消息、写完成和连接状态回调，连接断开后挂起中的读写都会被恢复
+同一时间最多一个读和一个写在等待，读写都必须在连接所在的loop线程中co_await
+*/
+class CoConnection
+{
+    struct State;
+
+public:
+    explicit CoConnection(const TcpConnectionPtr &conn)
+        : state_(std::make_shared<State>())
+    {
+        state_->conn = conn;
+        std::shared_ptr<State> state(state_);
+        conn->setMessageCallback([state](const TcpConnectionPtr &, Buffer *buf, Timestamp)
+                                 {
+                                     state->input = buf;
+                                     if (state->reader && state->readable())
+                                     {
+                                         // 在handleRead中直接恢复等待读的协程
+                                         std::exchange(state->reader, nullptr).resume();
+                                     } });
+        conn->setWriteCompleteCallbac([state](const TcpConnectionPtr &)
+                                      {
+                                          if (state->writer)
+                                          {
+                                              std::exchange(state->writer, nullptr).resume();
+                                          } });
+        conn->setConnectionCallback([state](const TcpConnectionPtr &c)
+                                    {
+                                        if (!c->connected())
+                                        {
+                                            state->detachInput();
+                                            state->closed = true;
+                                            std::coroutine_handle<> reader = std::exchange(state->reader, nullptr);
+                                            std::coroutine_handle<> writer = std::exchange(state->writer, nullptr);
+                                            if (reader)
+                                            {
+                                                reader.resume();
+                                            }
+                                            if (writer)
+                                            {
+                                                writer.resume();
+                                            }
+                                        } });
+    }
+
+    TcpConnectionPtr connection() const { return state_->conn.lock(); }
+    bool closed() const { return state_->closed; }
+
+    class ReadAwaiter
+    {
+    public:
+        bool await_ready() const { return state_->readable(); }
+        void await_suspend(std::coroutine_handle<> h) { state_->reader = h; }
+        // 连接关闭且剩下的数据不够时返回空字符串
+        std::string await_resume() { return state_->take(); }
+
+    private:
+        friend class CoConnection;
+        explicit ReadAwaiter(const std::shared_ptr<State> &state) : state_(state) {}
+        std::shared_ptr<State> state_;
+    };
+
+    class WriteAwaiter
+    {
+    public:
+        // 数据在这里交给TcpConnection，能一次写完时不挂起
+        bool await_ready()
+        {
+            TcpConnectionPtr conn = state_->conn.lock();
+            if (!conn || state_->closed)
+            {
+                return true;
+            }
+            conn->send(data_, len_);
+            return conn->pendingOutputBytes() == 0;
+        }
+        void await_suspend(std::coroutine_handle<> h) { state_->writer = h; }
+        // 返回false表示连接已经断开
+        bool await_resume() const { return !state_->closed; }
+
+    private:
+        friend class CoConnection;
+        WriteAwaiter(const std::shared_ptr<State> &state, const void *data, size_t len)
+            : state_(state), data_(data), len_(len) {}
+        std::shared_ptr<State> state_;
+        const void *data_;
+        size_t len_;
+    };
+
+    // 读取恰好n个字节
+    ReadAwaiter read(size_t n)
+    {
+        state_->need = n;
+        state_->delim.clear();
+        return ReadAwaiter(state_);
+    }
+
+    // 读取到delim为止 返回的数据包含delim
+    ReadAwaiter readUntil(const std::string &delim)
+    {
+        state_->need = 0;
+        state_->delim = delim;
+        return ReadAwaiter(state_);
+    }
+
+    // 等待数据发送完成(写入内核)后恢复 data只需要在co_await期间有效
+    WriteAwaiter write(const void *data, size_t len) { return WriteAwaiter(state_, data, len); }
+    WriteAwaiter write(const std::string &data) { return WriteAwaiter(state_, data.data(), data.size()); }
+
+private:
+    struct State
+    {
+        std::weak_ptr<TcpConnection> conn;
+        Buffer *input = nullptr; // 第一次收到数据时记录连接的inputBuffer_ 连接关闭后指向rest
+        Buffer rest{0};          // 连接关闭时还没读走的数据
+        std::coroutine_handle<> reader;
+        std::coroutine_handle<> writer;
+        size_t need = 0;
+        std::string delim;
+        size_t found = Buffer::npos;
+        bool closed = false;
+
+        // 本次读取的数据已经到齐，或者连接已经关闭
+        bool readable() { return complete() || closed; }
+
+        // 数据是否已经到齐 按delim读取时在found中记下要取走的长度
+        bool complete()
+        {
+            found = Buffer::npos;
+            if (!input)
+            {
+                return false;
+            }
+            size_t readableBytes = input->readableBytes();
+            if (delim.empty())
+            {
+                found = readableBytes >= need ? need : Buffer::npos;
+                return found != Buffer::npos;
+            }
+            for (size_t pos = input->findByte(delim[0]); pos != Buffer::npos; pos = input->findByte(delim[0], pos + 1))
+            {
+                if (readableBytes - pos < delim.size())
+                {
+                    break; // 剩下的数据放不下delim
+                }
+                if (memcmp(input->peek() + pos, delim.data(), delim.size()) == 0)
+                {
+                    found = pos + delim.size();
+                    break;
+                }
+            }
+            return found != Buffer::npos;
+        }
+
+        // 连接析构后inputBuffer_失效 把还没读走的数据拷贝到rest，之后的读取从rest中取
+        void detachInput()
+        {
+            if (input && input != &rest)
+            {
+                rest.append(input->peek(), input->readableBytes());
+            }
+            input = &rest;
+        }
+
+        std::string take()
+        {
+            if (!complete() || found == 0)
+            {
+                return std::string();
+            }
+            std::string result(input->peek(), found);
+            input->retrieve(found);
+            return result;
+        }
+    };
+
+    std::shared_ptr<State> state_;
+};
+
+#endif
@@ -2,12 +2,17 @@
 #include "Logger.h"
 #include "Poller.h"
 #include "Channel.h"
+#include "TimerQueue.h"
+#include "TcpConnection.h"
+#include "LoopChannel.h"
+#include "BufferArena.h"
 
 #include <sys/eventfd.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <memory>
+#include <algorithm>
 
 // 防止一个线程创建多个EventLoop __thread (thread_local)
 __thread EventLoop *t_loopInThisThread = nullptr;
@@ -31,7 +36,10 @@ EventLoop::EventLoop()
       quit_(false),
       callingPendingFunctors_(false),
       threadId_(CurrentThread::tid()),
+      busyNanoSeconds_(0),
       poller_(Poller::newDefaultPoller(this)),
+      timerQueue_(new TimerQueue(this)),
+      bufferArena_(new BufferArena),
       wakeupFd_(createEventfd()),
       wakeupChannel_(new Channel(this, wakeupFd_)),
       currentActiveChannel_(nullptr)
@@ -53,10 +61,18 @@ EventLoop::EventLoop()
 }
 EventLoop::~EventLoop()
 {
+    // loop退出后排队的关闭不会再执行 在这里放开连接的自身引用，连接归还缓冲区后再detach内存池
+    std::unordered_set<TcpConnectionHandle *> anchors;
+    anchors.swap(anchors_);
+    for (TcpConnectionHandle *anchor : anchors)
+    {
+        TcpConnectionHandle last(std::move(*anchor)); // anchor是连接的成员，可能随连接一起析构
+    }
     wakeupChannel_->disableAll(); // 对所有事件不感兴趣
     wakeupChannel_->remove();     // 从Poller中移除
     ::close(wakeupFd_);
     t_loopInThisThread = nullptr;
+    bufferArena_->detach();
 }
 
 // 开启事件循环
@@ -70,6 +86,7 @@ void EventLoop::loop()
     {
         activeChannels_.clear();
         pollReturnTime_ = poller_->poll(kPollTimesMs, &activeChannels_);
+        int64_t busyStart = Timestamp::monotonicNanoSeconds();
         for (Channel *channel : activeChannels_)
         {
             // Poller监听哪些channel发生了事件，上报给EventLoop，通知Channel处理相应的事件
@@ -79,12 +96,24 @@ void EventLoop::loop()
         currentActiveChannel_ = NULL;
         // 执行当前EventLoop事件循环需要处理的回调操作
         doPendingFunctors(); // 处理待执行的用户回调函数
+        busyNanoSeconds_.store(busyNanoSeconds_.load(std::memory_order_relaxed) +
+                                   Timestamp::monotonicNanoSeconds() - busyStart,
+                               std::memory_order_relaxed);
     }
 
     LOG_INFO("EventLoop %p stop looping \n", this);
     looping_ = false;
 }
 
+Timestamp EventLoop::now() const
+{
+    if (looping_ && isInLoopThread() && pollReturnTime_.valid())
+    {
+        return pollReturnTime_;
+    }
+    return Timestamp::now();
+}
+
 // 退出事件循环 1. loop在自己的线程中调用quit 2. 在非loop的线程中调用loop的quit
 void EventLoop::quit()
 {
@@ -141,6 +170,28 @@ void EventLoop::wakeup()
     }
 }
 
+TimerId EventLoop::runAt(Timestamp time, TimerCallback cb)
+{
+    return timerQueue_->addTimer(std::move(cb), time, 0.0);
+}
+
+TimerId EventLoop::runAfter(double delay, TimerCallback cb)
+{
+    Timestamp time(addTime(Timestamp::now(), delay));
+    return runAt(time, std::move(cb));
+}
+
+TimerId EventLoop::runEvery(double interval, TimerCallback cb)
+{
+    Timestamp time(addTime(Timestamp::now(), interval));
+    return timerQueue_->addTimer(std::move(cb), time, interval);
+}
+
+void EventLoop::cancel(TimerId timerId)
+{
+    timerQueue_->cancel(timerId);
+}
+
 void EventLoop::updateChannel(Channel *channel)
 {
     poller_->updateChannel(channel);
@@ -153,7 +204,7 @@ void EventLoop::removeChannel(Channel *channel)
 
 bool EventLoop::hasChannel(Channel *channel)
 {
-    poller_->hasChannel(channel);
+    return poller_->hasChannel(channel);
 }
 
 void EventLoop::doPendingFunctors()
@@ -172,5 +223,48 @@ void EventLoop::doPendingFunctors()
     {
         functor(); // 执行当前loop需要执行的回调操作
     }
+    // 处理其他loop通过LoopChannel发来的消息 其中的send和queueInLoop同样在本轮生效
+    drainLoopChannels();
+    // 刷新期间queueInLoop的回调(如writeComplete)会唤醒loop，不会被延迟到下一次poll超时
+    flushDirtyConnections();
     callingPendingFunctors_ = false;
-}
\ No newline at end of file
+}
+
+// 事件回调和pendingFunctors都执行完后，每个cork的连接只write一次
+void EventLoop::flushDirtyConnections()
+{
+    while (!dirtyConnections_.empty())
+    {
+        flushingConnections_.swap(dirtyConnections_);
+        for (const TcpConnectionHandle &conn : flushingConnections_)
+        {
+            conn->flushCorked();
+        }
+        flushingConnections_.clear(); // 保留容量，避免每轮循环都分配内存
+    }
+}
+
+void EventLoop::drainLoopChannels()
+{
+    if (loopChannels_.empty())
+    {
+        return;
+    }
+    bool hasClosed = false;
+    for (size_t i = 0; i < loopChannels_.size(); ++i)
+    {
+        if (loopChannels_[i]->closed())
+        {
+            hasClosed = true;
+            continue;
+        }
+        loopChannels_[i]->drain();
+    }
+    if (hasClosed)
+    {
+        loopChannels_.erase(std::remove_if(loopChannels_.begin(), loopChannels_.end(),
+                                           [](const std::shared_ptr<LoopChannelBase> &channel)
+                                           { return channel->closed(); }),
+                            loopChannels_.end());
+    }
+}
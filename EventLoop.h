@@ -3,15 +3,22 @@
 #include "noncopyable.h"
 #include "Timestamp.h"
 #include "CurrentThread.h"
+#include "Callbacks.h"
+#include "TimerId.h"
+#include "TcpConnectionHandle.h"
 
 #include <functional>
 #include <vector>
 #include <atomic>
 #include <memory>
 #include <mutex>
+#include <unordered_set>
 
 class Channel;
 class Poller;
+class TimerQueue;
+class LoopChannelBase;
+class BufferArena;
 
 // 事件循环类，主要包含了Channel和Poller（epoll的抽象）
 class EventLoop : noncopyable
@@ -25,12 +32,35 @@ public:
     void quit(); // 退出事件循环
 
     Timestamp pollReturnTime() const { return pollReturnTime_; }
+    // 本轮循环缓存的时间 loop线程内的回调读取它不需要再取一次时钟 其他线程调用时返回实时时间
+    Timestamp now() const;
+    // 处理事件和回调累计花费的时间(不含阻塞在epoll_wait上的时间) 用于统计loop的负载 可以在任意线程调用
+    int64_t busyNanoSeconds() const { return busyNanoSeconds_.load(std::memory_order_relaxed); }
 
     void runInLoop(Functor cb);   // 在当前loop中执行
     void queueInLoop(Functor cb); // 把cb放入队列中，唤醒loop所在的线程，执行cb
 
     void wakeup(); // 唤醒loop所在的线程
 
+    // 定时器 线程安全 回调总是在loop所在线程中执行
+    TimerId runAt(Timestamp time, TimerCallback cb);      // 在time时刻执行cb
+    TimerId runAfter(double delay, TimerCallback cb);     // delay秒之后执行cb
+    TimerId runEvery(double interval, TimerCallback cb);  // 每隔interval秒执行一次cb
+    void cancel(TimerId timerId);                         // 取消定时器
+
+    // 登记一个cork模式下有待发送数据的连接，在本轮循环结束时调用其flushCorked 只能在loop线程中调用
+    void queueFlush(const TcpConnectionHandle &conn) { dirtyConnections_.push_back(conn); }
+
+    // 登记本loop上连接持有的自身锚点 loop析构时释放，不让没有关闭的连接和锚点互相持有而泄漏 只能在loop线程中调用
+    void addAnchor(TcpConnectionHandle *anchor) { anchors_.insert(anchor); }
+    void removeAnchor(TcpConnectionHandle *anchor) { anchors_.erase(anchor); }
+
+    // 登记一个以本loop为消费者的LoopChannel，每轮循环结束时排空 只能在loop线程中调用
+    void addLoopChannel(const std::shared_ptr<LoopChannelBase> &channel) { loopChannels_.push_back(channel); }
+
+    // 本loop的Buffer内存池 在本loop中运行的连接从这里分配缓冲区
+    BufferArena *bufferArena() const { return bufferArena_; }
+
     // Eventloop的方法调用Poller的方法
     void updateChannel(Channel *channel);
     void removeChannel(Channel *channel);
@@ -42,6 +72,8 @@ public:
 private:
     void handleRead();
     void doPendingFunctors(); // 执行回调
+    void flushDirtyConnections();
+    void drainLoopChannels();
 
     using ChannelList = std::vector<Channel *>;
 
@@ -50,7 +82,10 @@ private:
     std::atomic_bool callingPendingFunctors_; // 标识当前loop是否有需要执行的回调操作
     const pid_t threadId_;                    // 记录当前loop所在线程的id
     Timestamp pollReturnTime_;                // poller返回发生事件的channels的时间点
+    std::atomic<int64_t> busyNanoSeconds_;    // 只在loop线程中写
     std::unique_ptr<Poller> poller_;          // 指向Poller类的智能指针，用于处理事件的监听和分发
+    std::unique_ptr<TimerQueue> timerQueue_;  // 定时器队列 timerfd也注册在poller_上
+    BufferArena *bufferArena_;                 // loop析构时detach 最后一块内存归还后自己释放
 
     int wakeupFd_; // 当mainloop获取一个新用户的channel，通过轮询算法选择一个subloop，通过该成员唤醒subloop处理channel
     std::unique_ptr<Channel> wakeupChannel_;
@@ -60,4 +95,10 @@ private:
 
     std::vector<Functor> pendingFunctors_; // 存储loop需要执行的所有回调操作
     std::mutex mutex_;                     // 互斥锁用来保护上面vector容器线程安全操作
+
+    std::vector<TcpConnectionHandle> dirtyConnections_; // 本轮循环中cork的连接 只在loop线程中访问
+    std::vector<TcpConnectionHandle> flushingConnections_;
+    std::unordered_set<TcpConnectionHandle *> anchors_; // 只在loop线程中访问
+
+    std::vector<std::shared_ptr<LoopChannelBase>> loopChannels_; // 以本loop为消费者的通道 只在loop线程中访问
 };
\ No newline at end of file
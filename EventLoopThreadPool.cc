@@ -59,4 +59,8 @@ std::vector<EventLoop *> EventLoopThreadPool::getAllLoops()
     {
         return std::vector<EventLoop *>(1, baseloop_);
     }
+    else
+    {
+        return loops_;
+    }
 }
\ No newline at end of file
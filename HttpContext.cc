@@ -0,0 +1,228 @@
+#include "HttpContext.h"
+
+#include <algorithm>
+#include <ctype.h>
+
+const size_t HttpContext::kMaxHeaderBytes;
+const size_t HttpContext::kMaxBodyBytes;
+
+HttpContext::HttpContext()
+    : state_(kExpectRequestLine),
+      lineStart_(0),
+      searchFrom_(0),
+      bodyStart_(0),
+      contentLength_(0),
+      errorCode_(0)
+{
+}
+
+void HttpContext::reset()
+{
+    state_ = kExpectRequestLine;
+    lineStart_ = 0;
+    searchFrom_ = 0;
+    bodyStart_ = 0;
+    contentLength_ = 0;
+    errorCode_ = 0;
+    request_.reset();
+}
+
+HttpContext::ParseResult HttpContext::fail(int code)
+{
+    errorCode_ = code;
+    state_ = kFailed;
+    return kError;
+}
+
+HttpContext::ParseResult HttpContext::parse(const Buffer *buf, Timestamp receiveTime)
+{
+    if (state_ == kFailed)
+    {
+        return kError;
+    }
+
+    const char *base = buf->peek();
+    const size_t readable = buf->readableBytes();
+
+    while (state_ == kExpectRequestLine || state_ == kExpectHeaders)
+    {
+        size_t lineEnd = buf->findCRLF(searchFrom_);
+        if (lineEnd == Buffer::npos)
+        {
+            // 行不完整，下次从最后一个字节开始找(它可能是'\r')
+            searchFrom_ = std::max(lineStart_, readable > 0 ? readable - 1 : 0);
+            if (readable > kMaxHeaderBytes)
+            {
+                return fail(431);
+            }
+            return kIncomplete;
+        }
+
+        if (state_ == kExpectRequestLine)
+        {
+            // 兼容请求之间多余的空行
+            if (lineEnd != lineStart_)
+            {
+                if (!parseRequestLine(base, lineStart_, lineEnd))
+                {
+                    return fail(errorCode_ != 0 ? errorCode_ : 400);
+                }
+                state_ = kExpectHeaders;
+            }
+        }
+        else if (lineEnd == lineStart_)
+        {
+            // 空行 头部结束
+            bodyStart_ = lineEnd + 2;
+            if (!headersDone(base))
+            {
+                return fail(errorCode_ != 0 ? errorCode_ : 400);
+            }
+        }
+        else if (!parseHeader(base, lineStart_, lineEnd))
+        {
+            return fail(400);
+        }
+        lineStart_ = lineEnd + 2;
+        searchFrom_ = lineStart_;
+    }
+
+    if (state_ == kExpectBody)
+    {
+        if (readable < bodyStart_ + contentLength_)
+        {
+            return kIncomplete;
+        }
+        request_.body_ = HttpRequest::Span(bodyStart_, contentLength_);
+        state_ = kGotAll;
+    }
+
+    request_.base_ = base;
+    request_.receiveTime_ = receiveTime;
+    return kComplete;
+}
+
+// METHOD SP request-target SP HTTP/1.x
+bool HttpContext::parseRequestLine(const char *base, size_t begin, size_t end)
+{
+    const char *start = base + begin;
+    const char *stop = base + end;
+    const char *space = std::find(start, stop, ' ');
+    if (space == stop)
+    {
+        return false;
+    }
+
+    StringPiece method(start, space - start);
+    if (method == "GET")
+        request_.method_ = HttpRequest::kGet;
+    else if (method == "POST")
+        request_.method_ = HttpRequest::kPost;
+    else if (method == "HEAD")
+        request_.method_ = HttpRequest::kHead;
+    else if (method == "PUT")
+        request_.method_ = HttpRequest::kPut;
+    else if (method == "DELETE")
+        request_.method_ = HttpRequest::kDelete;
+    else if (method == "OPTIONS")
+        request_.method_ = HttpRequest::kOptions;
+    else if (method == "PATCH")
+        request_.method_ = HttpRequest::kPatch;
+    else
+        return false;
+    request_.methodSpan_ = HttpRequest::Span(begin, space - start);
+
+    start = space + 1;
+    space = std::find(start, stop, ' ');
+    if (space == stop || space == start)
+    {
+        return false;
+    }
+    const char *question = std::find(start, space, '?');
+    request_.path_ = HttpRequest::Span(start - base, question - start);
+    if (question != space)
+    {
+        request_.query_ = HttpRequest::Span(question + 1 - base, space - question - 1);
+    }
+
+    StringPiece version(space + 1, stop - space - 1);
+    if (version == "HTTP/1.1")
+    {
+        request_.version_ = HttpRequest::kHttp11;
+    }
+    else if (version == "HTTP/1.0")
+    {
+        request_.version_ = HttpRequest::kHttp10;
+    }
+    else if (version.startsWith("HTTP/"))
+    {
+        request_.version_ = HttpRequest::kUnknown;
+        errorCode_ = 505;
+        return false;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+// field-name ":" OWS field-value OWS
+bool HttpContext::parseHeader(const char *base, size_t begin, size_t end)
+{
+    const char *start = base + begin;
+    const char *stop = base + end;
+    const char *colon = std::find(start, stop, ':');
+    if (colon == stop || colon == start)
+    {
+        return false;
+    }
+
+    const char *value = colon + 1;
+    while (value < stop && (*value == ' ' || *value == '\t'))
+    {
+        ++value;
+    }
+    const char *valueEnd = stop;
+    while (valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t'))
+    {
+        --valueEnd;
+    }
+
+    request_.headers_.push_back(HttpRequest::Header(HttpRequest::Span(begin, colon - start),
+                                                    HttpRequest::Span(value - base, valueEnd - value)));
+    return true;
+}
+
+bool HttpContext::headersDone(const char *base)
+{
+    request_.base_ = base; // getHeader需要base_
+    if (!request_.getHeader("Transfer-Encoding").empty())
+    {
+        // 暂不支持分块编码的请求体
+        errorCode_ = 501;
+        return false;
+    }
+
+    StringPiece length = request_.getHeader("Content-Length");
+    contentLength_ = 0;
+    if (!length.empty())
+    {
+        for (size_t i = 0; i < length.size(); ++i)
+        {
+            if (!isdigit(static_cast<unsigned char>(length[i])) || contentLength_ > kMaxBodyBytes)
+            {
+                errorCode_ = isdigit(static_cast<unsigned char>(length[i])) ? 413 : 400;
+                return false;
+            }
+            contentLength_ = contentLength_ * 10 + (length[i] - '0');
+        }
+        if (contentLength_ > kMaxBodyBytes)
+        {
+            errorCode_ = 413;
+            return false;
+        }
+    }
+    state_ = kExpectBody;
+    return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "HttpRequest.h"
+#include "Buffer.h"
+
+/*
+每个连接一个的HTTP增量解析器
+数据不完整时记录已经扫描过的位置，下次从断点继续，不重复扫描，也不从Buffer中取出数据
+一个请求完整后由HttpServer回收requestLength()字节并reset，继续解析流水线中的下一个请求
+*/
+class HttpContext : noncopyable
+{
+public:
+    enum ParseResult
+    {
+        kIncomplete,
+        kComplete,
+        kError
+    };
+
+    static const size_t kMaxHeaderBytes = 64 * 1024;
+    static const size_t kMaxBodyBytes = 64 * 1024 * 1024;
+
+    HttpContext();
+
+    ParseResult parse(const Buffer *buf, Timestamp receiveTime);
+
+    // 只在parse返回kComplete后有效
+    const HttpRequest &request() const { return request_; }
+    size_t requestLength() const { return bodyStart_ + contentLength_; }
+    // parse返回kError时对应的HTTP状态码
+    int errorCode() const { return errorCode_; }
+    // 出错后不再解析 之后的数据都应该丢弃
+    bool failed() const { return state_ == kFailed; }
+
+    // 解析下一个请求之前调用
+    void reset();
+
+    // 复用的响应缓冲区，同一次onMessage中流水线请求的响应都写在这里
+    Buffer *output() { return &output_; }
+
+private:
+    enum State
+    {
+        kExpectRequestLine,
+        kExpectHeaders,
+        kExpectBody,
+        kGotAll,
+        kFailed // 出错后的终止状态 只有reset能离开
+    };
+
+    bool parseRequestLine(const char *base, size_t begin, size_t end);
+    bool parseHeader(const char *base, size_t begin, size_t end);
+    bool headersDone(const char *base);
+    ParseResult fail(int code);
+
+    State state_;
+    size_t lineStart_;  // 当前行的起始偏移
+    size_t searchFrom_; // 下次查找CRLF的起始偏移
+    size_t bodyStart_;
+    size_t contentLength_;
+    int errorCode_;
+    HttpRequest request_;
+    Buffer output_;
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "copyable.h"
+#include "StringPiece.h"
+#include "Timestamp.h"
+
+#include <vector>
+#include <utility>
+
+/*
+HTTP请求 不拷贝任何数据，各字段以相对于请求起始位置的偏移保存
+只在HttpCallback执行期间有效，回调返回后底层Buffer中的数据会被回收
+*/
+class HttpRequest : public copyable
+{
+public:
+    enum Method
+    {
+        kInvalid,
+        kGet,
+        kPost,
+        kHead,
+        kPut,
+        kDelete,
+        kOptions,
+        kPatch
+    };
+
+    enum Version
+    {
+        kUnknown,
+        kHttp10,
+        kHttp11
+    };
+
+    HttpRequest() : base_(nullptr), method_(kInvalid), version_(kUnknown) {}
+
+    Method method() const { return method_; }
+    Version version() const { return version_; }
+    StringPiece methodString() const { return piece(methodSpan_); }
+    StringPiece path() const { return piece(path_); }
+    StringPiece query() const { return piece(query_); }
+    StringPiece body() const { return piece(body_); }
+    Timestamp receiveTime() const { return receiveTime_; }
+
+    // 忽略大小写查找头部，不存在时返回空
+    StringPiece getHeader(const StringPiece &field) const
+    {
+        for (const Header &h : headers_)
+        {
+            if (piece(h.first).equalsIgnoreCase(field))
+            {
+                return piece(h.second);
+            }
+        }
+        return StringPiece();
+    }
+
+    size_t headerCount() const { return headers_.size(); }
+    StringPiece headerName(size_t i) const { return piece(headers_[i].first); }
+    StringPiece headerValue(size_t i) const { return piece(headers_[i].second); }
+
+    // HTTP/1.1默认保持连接，HTTP/1.0需要显式的keep-alive
+    bool keepAlive() const
+    {
+        StringPiece connection = getHeader("Connection");
+        if (version_ == kHttp11)
+        {
+            return !connection.equalsIgnoreCase("close");
+        }
+        return connection.equalsIgnoreCase("keep-alive");
+    }
+
+private:
+    friend class HttpContext;
+
+    struct Span
+    {
+        Span() : offset(0), len(0) {}
+        Span(size_t o, size_t l) : offset(o), len(l) {}
+        size_t offset;
+        size_t len;
+    };
+    using Header = std::pair<Span, Span>;
+
+    StringPiece piece(const Span &s) const { return StringPiece(base_ + s.offset, s.len); }
+
+    void reset()
+    {
+        base_ = nullptr;
+        method_ = kInvalid;
+        version_ = kUnknown;
+        methodSpan_ = path_ = query_ = body_ = Span();
+        headers_.clear(); // 保留容量，下一个请求复用
+    }
+
+    const char *base_; // 请求在Buffer中的起始地址 请求完整时才设置
+    Method method_;
+    Version version_;
+    Span methodSpan_;
+    Span path_;
+    Span query_;
+    Span body_;
+    std::vector<Header> headers_;
+    Timestamp receiveTime_;
+};
@@ -0,0 +1,132 @@
+#include "HttpResponse.h"
+#include "Buffer.h"
+
+#include <stdio.h>
+
+HttpResponse::HttpResponse(Buffer *output, HttpRequest::Version version, bool close, bool headRequest)
+    : output_(output),
+      version_(version),
+      closeConnection_(close),
+      headRequest_(headRequest),
+      state_(kStart)
+{
+}
+
+void HttpResponse::setStatusCode(int code, const StringPiece &message)
+{
+    if (state_ != kStart)
+    {
+        return;
+    }
+    char buf[32];
+    int n = snprintf(buf, sizeof buf, "HTTP/1.1 %d ", code);
+    output_->append(buf, n);
+    output_->append(message.data(), message.size());
+    output_->append("\r\n", 2);
+    state_ = kHeaders;
+}
+
+void HttpResponse::ensureStatusLine()
+{
+    if (state_ == kStart)
+    {
+        setStatusCode(200, "OK");
+    }
+}
+
+void HttpResponse::addHeader(const StringPiece &field, const StringPiece &value)
+{
+    ensureStatusLine();
+    if (state_ != kHeaders)
+    {
+        return;
+    }
+    output_->append(field.data(), field.size());
+    output_->append(": ", 2);
+    output_->append(value.data(), value.size());
+    output_->append("\r\n", 2);
+}
+
+void HttpResponse::endHeaders()
+{
+    if (closeConnection_)
+    {
+        output_->append("Connection: close\r\n\r\n", 21);
+    }
+    else
+    {
+        if (version_ == HttpRequest::kHttp10)
+        {
+            output_->append("Connection: Keep-Alive\r\n", 24);
+        }
+        output_->append("\r\n", 2);
+    }
+}
+
+void HttpResponse::setBody(const StringPiece &body)
+{
+    ensureStatusLine();
+    if (state_ != kHeaders)
+    {
+        return;
+    }
+    char buf[48];
+    int n = snprintf(buf, sizeof buf, "Content-Length: %lu\r\n", body.size());
+    output_->append(buf, n);
+    endHeaders();
+    if (!headRequest_)
+    {
+        output_->append(body.data(), body.size());
+    }
+    state_ = kFinished;
+}
+
+void HttpResponse::sendChunk(const StringPiece &data)
+{
+    ensureStatusLine();
+    if (state_ == kHeaders)
+    {
+        if (version_ == HttpRequest::kHttp10)
+        {
+            // HTTP/1.0不支持分块编码，以关闭连接表示响应结束
+            closeConnection_ = true;
+        }
+        else
+        {
+            output_->append("Transfer-Encoding: chunked\r\n", 28);
+        }
+        endHeaders();
+        state_ = kChunked;
+    }
+    if (state_ != kChunked || data.empty() || headRequest_)
+    {
+        return;
+    }
+
+    if (version_ == HttpRequest::kHttp10)
+    {
+        output_->append(data.data(), data.size());
+        return;
+    }
+    char buf[32];
+    int n = snprintf(buf, sizeof buf, "%lx\r\n", data.size());
+    output_->append(buf, n);
+    output_->append(data.data(), data.size());
+    output_->append("\r\n", 2);
+}
+
+void HttpResponse::finish()
+{
+    if (state_ == kStart || state_ == kHeaders)
+    {
+        setBody(StringPiece());
+    }
+    else if (state_ == kChunked)
+    {
+        if (version_ != HttpRequest::kHttp10 && !headRequest_)
+        {
+            output_->append("0\r\n\r\n", 5);
+        }
+        state_ = kFinished;
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "StringPiece.h"
+#include "HttpRequest.h"
+
+class Buffer;
+
+/*
+HTTP响应 直接写入输出Buffer，不在中间拼接字符串
+调用顺序: setStatusCode -> addHeader* -> setBody 或 sendChunk* + finish
+没有调用setStatusCode时默认200 OK
+*/
+class HttpResponse : noncopyable
+{
+public:
+    HttpResponse(Buffer *output, HttpRequest::Version version, bool close, bool headRequest = false);
+
+    void setStatusCode(int code, const StringPiece &message);
+    void addHeader(const StringPiece &field, const StringPiece &value);
+    void setContentType(const StringPiece &contentType) { addHeader("Content-Type", contentType); }
+
+    // 一次性写入完整的响应体，响应结束
+    void setBody(const StringPiece &body);
+    // 分块发送响应体 第一次调用时写入Transfer-Encoding: chunked
+    void sendChunk(const StringPiece &data);
+    // 结束响应 分块编码时写入最后的0长度块
+    void finish();
+
+    void setCloseConnection(bool on) { closeConnection_ = on; }
+    bool closeConnection() const { return closeConnection_; }
+    bool finished() const { return state_ == kFinished; }
+
+private:
+    enum State
+    {
+        kStart,
+        kHeaders,
+        kChunked,
+        kFinished
+    };
+
+    void ensureStatusLine();
+    void endHeaders();
+
+    Buffer *output_;
+    HttpRequest::Version version_;
+    bool closeConnection_;
+    bool headRequest_; // HEAD请求只发送头部
+    State state_;
+};
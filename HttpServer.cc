@@ -0,0 +1,103 @@
+#include "HttpServer.h"
+#include "HttpContext.h"
+#include "Logger.h"
+
+#include <stdio.h>
+
+// 默认回调 所有请求返回404
+static void defaultHttpCallback(const HttpRequest &, HttpResponse *resp)
+{
+    resp->setStatusCode(404, "Not Found");
+    resp->setBody("Not Found");
+}
+
+static const char *errorReason(int code)
+{
+    switch (code)
+    {
+    case 413:
+        return "Payload Too Large";
+    case 431:
+        return "Request Header Fields Too Large";
+    case 501:
+        return "Not Implemented";
+    case 505:
+        return "HTTP Version Not Supported";
+    default:
+        return "Bad Request";
+    }
+}
+
+HttpServer::HttpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &name, TcpServer::Option option)
+    : loop_(loop),
+      server_(loop, listenAddr, name, option),
+      httpCallback_(defaultHttpCallback)
+{
+    server_.setConnectionCallback(std::bind(&HttpServer::onConnection, this, std::placeholders::_1));
+    server_.setMessageCallback(std::bind(&HttpServer::onMessage, this,
+                                         std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+void HttpServer::start()
+{
+    server_.start();
+}
+
+void HttpServer::onConnection(const TcpConnectionPtr &conn)
+{
+    if (conn->connected())
+    {
+        conn->setContext(std::make_shared<HttpContext>());
+    }
+}
+
+void HttpServer::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+{
+    HttpContext *context = static_cast<HttpContext *>(conn->getContext().get());
+    if (context->failed())
+    {
+        // 已经回复错误并关闭写端 对端在关闭前继续发来的数据直接丢弃
+        buf->retrieveAll();
+        return;
+    }
+    Buffer *output = context->output();
+    bool close = false;
+
+    // 流水线中的请求依次解析处理，响应按请求顺序追加到output
+    while (!close)
+    {
+        HttpContext::ParseResult result = context->parse(buf, receiveTime);
+        if (result == HttpContext::kIncomplete)
+        {
+            break;
+        }
+
+        if (result == HttpContext::kError)
+        {
+            HttpResponse resp(output, HttpRequest::kHttp11, true);
+            resp.setStatusCode(context->errorCode(), errorReason(context->errorCode()));
+            resp.setBody(errorReason(context->errorCode()));
+            buf->retrieveAll();
+            close = true;
+            break;
+        }
+
+        const HttpRequest &req = context->request();
+        HttpResponse resp(output, req.version(), !req.keepAlive(), req.method() == HttpRequest::kHead);
+        httpCallback_(req, &resp);
+        resp.finish();
+        close = resp.closeConnection();
+
+        buf->retrieve(context->requestLength());
+        context->reset();
+    }
+
+    if (output->readableBytes() > 0)
+    {
+        conn->send(output);
+    }
+    if (close)
+    {
+        conn->shutdown();
+    }
+}
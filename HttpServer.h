@@ -0,0 +1,39 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "TcpServer.h"
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+
+#include <functional>
+#include <string>
+
+/*
+基于TcpServer的HTTP/1.1服务器
+支持keep-alive和流水线请求，同一次可读事件中解析出的多个请求按顺序处理，
+响应写入同一个输出缓冲区后一次发送
+*/
+class HttpServer : noncopyable
+{
+public:
+    // 回调返回前必须完成响应(setBody或finish)，否则由HttpServer调用finish
+    using HttpCallback = std::function<void(const HttpRequest &, HttpResponse *)>;
+
+    HttpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &name,
+               TcpServer::Option option = TcpServer::kNoReusePort);
+
+    EventLoop *getLoop() const { return loop_; }
+
+    void setHttpCallback(const HttpCallback &cb) { httpCallback_ = cb; }
+    void setThreadNum(int numThreads) { server_.setThreadNum(numThreads); }
+
+    void start();
+
+private:
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+    EventLoop *loop_;
+    TcpServer server_;
+    HttpCallback httpCallback_;
+};
@@ -1,43 +1,175 @@
 #include "InetAddress.h"
+#include "Logger.h"
 
 #include <strings.h>
 #include <sys/socket.h>
 #include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <algorithm>
 
 InetAddress::InetAddress(uint16_t port, std::string ip)
 {
-    bzero(&addr_, sizeof(addr_));
-    addr_.sin_family = AF_INET;
-    addr_.sin_port = htons(port);
-    addr_.sin_addr.s_addr = inet_addr(ip.c_str());
+    bzero(&unix_, sizeof(unix_));
+    if (ip.find(':') != std::string::npos)
+    {
+        addr6_.sin6_family = AF_INET6;
+        addr6_.sin6_port = htons(port);
+        if (::inet_pton(AF_INET6, ip.c_str(), &addr6_.sin6_addr) <= 0)
+        {
+            LOG_ERROR("InetAddress invalid ipv6 address %s \n", ip.c_str());
+        }
+        len_ = sizeof addr6_;
+    }
+    else
+    {
+        addr_.sin_family = AF_INET;
+        addr_.sin_port = htons(port);
+        addr_.sin_addr.s_addr = inet_addr(ip.c_str());
+        len_ = sizeof addr_;
+    }
+}
+
+InetAddress InetAddress::unixDomain(const std::string &path)
+{
+    InetAddress addr;
+    bzero(&addr.unix_, sizeof(addr.unix_));
+    addr.unix_.sun_family = AF_UNIX;
+    size_t n = std::min(path.size(), sizeof(addr.unix_.sun_path) - 1);
+    memcpy(addr.unix_.sun_path, path.data(), n);
+    if (n > 0 && path[0] == '@')
+    {
+        // abstract namespace 第一个字节为'\0'，地址长度不包含结尾的'\0'
+        addr.unix_.sun_path[0] = '\0';
+        addr.len_ = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + n);
+    }
+    else
+    {
+        addr.len_ = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + n + 1);
+    }
+    return addr;
+}
+
+InetAddress InetAddress::localAddressOf(int sockfd)
+{
+    sockaddr_un storage; // 三种地址中最大的
+    bzero(&storage, sizeof storage);
+    socklen_t addrlen = sizeof storage;
+    InetAddress addr;
+    if (::getsockname(sockfd, (sockaddr *)&storage, &addrlen) < 0)
+    {
+        LOG_ERROR("sockets::getLocalAddr fd=%d err:%d \n", sockfd, errno);
+        return addr;
+    }
+    addr.setSockAddr((sockaddr *)&storage, addrlen);
+    return addr;
+}
+
+InetAddress InetAddress::peerAddressOf(int sockfd)
+{
+    sockaddr_un storage;
+    bzero(&storage, sizeof storage);
+    socklen_t addrlen = sizeof storage;
+    InetAddress addr;
+    if (::getpeername(sockfd, (sockaddr *)&storage, &addrlen) < 0)
+    {
+        LOG_ERROR("sockets::getPeerAddr fd=%d err:%d \n", sockfd, errno);
+        return addr;
+    }
+    addr.setSockAddr((sockaddr *)&storage, addrlen);
+    return addr;
+}
+
+void InetAddress::setSockAddrInet(const struct sockaddr_in &addr)
+{
+    bzero(&unix_, sizeof(unix_));
+    addr_ = addr;
+    len_ = sizeof addr_;
+}
+
+void InetAddress::setSockAddrInet6(const struct sockaddr_in6 &addr)
+{
+    bzero(&unix_, sizeof(unix_));
+    addr6_ = addr;
+    len_ = sizeof addr6_;
+}
+
+void InetAddress::setSockAddr(const struct sockaddr *addr, socklen_t len)
+{
+    bzero(&unix_, sizeof(unix_));
+    len = std::min(len, static_cast<socklen_t>(sizeof(unix_)));
+    memcpy(&unix_, addr, len);
+    len_ = len;
 }
 
 std::string InetAddress::toIp() const
 {
     char buf[64] = {0};
-    ::inet_ntop(AF_INET, &addr_.sin_addr, buf, sizeof(buf));
-    return buf;
+    switch (family())
+    {
+    case AF_INET6:
+        ::inet_ntop(AF_INET6, &addr6_.sin6_addr, buf, sizeof(buf));
+        return buf;
+    case AF_UNIX:
+    {
+        // 未命名的Unix域socket(如客户端)地址长度只有sun_family
+        size_t pathLen = len_ > offsetof(sockaddr_un, sun_path) ? len_ - offsetof(sockaddr_un, sun_path) : 0;
+        if (pathLen == 0)
+        {
+            return std::string();
+        }
+        if (unix_.sun_path[0] == '\0')
+        {
+            return "@" + std::string(unix_.sun_path + 1, pathLen - 1);
+        }
+        return std::string(unix_.sun_path, strnlen(unix_.sun_path, pathLen));
+    }
+    default:
+        ::inet_ntop(AF_INET, &addr_.sin_addr, buf, sizeof(buf));
+        return buf;
+    }
 }
 
 std::string InetAddress::toIpPort() const
 {
-    char buf[64] = {0};
-    ::inet_ntop(AF_INET, &addr_.sin_addr, buf, sizeof(buf));
-    size_t end = strlen(buf);
-    uint16_t port = ntohs(addr_.sin_port);
-    sprintf(buf + end, ":%u", port);
-    return buf;
+    switch (family())
+    {
+    case AF_INET6:
+        return "[" + toIp() + "]:" + std::to_string(toPort());
+    case AF_UNIX:
+        return "unix:" + toIp();
+    default:
+        return toIp() + ":" + std::to_string(toPort());
+    }
 }
 
 uint16_t InetAddress::toPort() const
 {
-    return ntohs(addr_.sin_port);
+    switch (family())
+    {
+    case AF_INET6:
+        return ntohs(addr6_.sin6_port);
+    case AF_UNIX:
+        return 0;
+    default:
+        return ntohs(addr_.sin_port);
+    }
 }
 
-// #include <iostream>
-// int main()
-// {
-//     InetAddress addr(8080);
-//     std::cout << addr.toIpPort() << std::endl;
-//     return 0;
-// }
\ No newline at end of file
+bool InetAddress::operator==(const InetAddress &rhs) const
+{
+    if (family() != rhs.family())
+    {
+        return false;
+    }
+    switch (family())
+    {
+    case AF_INET6:
+        return addr6_.sin6_port == rhs.addr6_.sin6_port &&
+               memcmp(&addr6_.sin6_addr, &rhs.addr6_.sin6_addr, sizeof addr6_.sin6_addr) == 0;
+    case AF_UNIX:
+        return len_ == rhs.len_ && memcmp(&unix_, &rhs.unix_, len_) == 0;
+    default:
+        return addr_.sin_port == rhs.addr_.sin_port && addr_.sin_addr.s_addr == rhs.addr_.sin_addr.s_addr;
+    }
+}
@@ -6,20 +6,48 @@
 #include <string>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 
+/*
+socket地址 支持AF_INET、AF_INET6和AF_UNIX
+Unix域地址的路径以'@'开头时表示abstract namespace(不在文件系统中创建文件)
+*/
 class InetAddress : public copyable
 {
 public:
+    // ip中含有':'时按IPv6解析，如"::1"、"::"
     explicit InetAddress(uint16_t port = 0, std::string ip = "127.0.0.1");
-    explicit InetAddress(const sockaddr_in &addr) : addr_(addr) {}
+    explicit InetAddress(const sockaddr_in &addr) { setSockAddrInet(addr); }
+    explicit InetAddress(const sockaddr_in6 &addr) { setSockAddrInet6(addr); }
 
+    static InetAddress unixDomain(const std::string &path);
+    // 获取socket绑定的本端地址和对端地址
+    static InetAddress localAddressOf(int sockfd);
+    static InetAddress peerAddressOf(int sockfd);
+
+    sa_family_t family() const { return addr_.sin_family; }
+    bool isUnixDomain() const { return family() == AF_UNIX; }
+
+    // Unix域地址返回路径
     std::string toIp() const;
     std::string toIpPort() const;
     uint16_t toPort() const;
 
-    const sockaddr_in *getSockAddr() const { return &addr_; }
-    void setSockAddrInet(const struct sockaddr_in &addr) { addr_ = addr; };
+    const sockaddr *getSockAddr() const { return reinterpret_cast<const sockaddr *>(&addr6_); }
+    socklen_t getSockLen() const { return len_; }
+    void setSockAddrInet(const struct sockaddr_in &addr);
+    void setSockAddrInet6(const struct sockaddr_in6 &addr);
+    // 从accept/getsockname/recvmsg得到的地址构造
+    void setSockAddr(const struct sockaddr *addr, socklen_t len);
+
+    bool operator==(const InetAddress &rhs) const;
 
 private:
-    sockaddr_in addr_;
-};
\ No newline at end of file
+    union
+    {
+        sockaddr_in addr_;
+        sockaddr_in6 addr6_;
+        sockaddr_un unix_;
+    };
+    socklen_t len_; // abstract namespace的地址长度由路径长度决定
+};
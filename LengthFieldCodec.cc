@@ -0,0 +1,132 @@
+#include "LengthFieldCodec.h"
+#include "TcpConnection.h"
+#include "Buffer.h"
+#include "Logger.h"
+
+#include <algorithm>
+
+const size_t LengthFieldCodec::kDefaultMaxFrameLength;
+const int LengthFieldCodec::kMaxRecvLowat;
+
+LengthFieldCodec::LengthFieldCodec(const FrameCallback &cb, size_t lengthFieldSize, size_t maxFrameLength)
+    : frameCallback_(cb),
+      lengthFieldSize_(lengthFieldSize),
+      maxFrameLength_(maxFrameLength),
+      useRecvLowat_(true)
+{
+    if (lengthFieldSize != 1 && lengthFieldSize != 2 && lengthFieldSize != 4 && lengthFieldSize != 8)
+    {
+        LOG_FATAL("LengthFieldCodec unsupported length field size:%lu \n", lengthFieldSize);
+    }
+}
+
+uint64_t LengthFieldCodec::peekLength(const Buffer *buf) const
+{
+    switch (lengthFieldSize_)
+    {
+    case 1:
+        return static_cast<uint8_t>(buf->peekInt8());
+    case 2:
+        return static_cast<uint16_t>(buf->peekInt16());
+    case 4:
+        return static_cast<uint32_t>(buf->peekInt32());
+    default:
+        return static_cast<uint64_t>(buf->peekInt64());
+    }
+}
+
+void LengthFieldCodec::prependLength(Buffer *buf, uint64_t len) const
+{
+    switch (lengthFieldSize_)
+    {
+    case 1:
+        buf->prependInt8(static_cast<int8_t>(len));
+        break;
+    case 2:
+        buf->prependInt16(static_cast<int16_t>(len));
+        break;
+    case 4:
+        buf->prependInt32(static_cast<int32_t>(len));
+        break;
+    default:
+        buf->prependInt64(static_cast<int64_t>(len));
+        break;
+    }
+}
+
+void LengthFieldCodec::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+{
+    size_t needed = lengthFieldSize_; // 下一个消息还差多少字节才完整
+    while (buf->readableBytes() >= lengthFieldSize_)
+    {
+        uint64_t len = peekLength(buf);
+        if (len > maxFrameLength_)
+        {
+            LOG_ERROR("LengthFieldCodec %s invalid frame length %lu \n", conn->name().c_str(), len);
+            if (errorCallback_)
+            {
+                errorCallback_(conn, len);
+            }
+            else
+            {
+                conn->forceClose();
+            }
+            buf->retrieveAll();
+            return;
+        }
+
+        if (buf->readableBytes() < lengthFieldSize_ + len)
+        {
+            needed = lengthFieldSize_ + len;
+            break;
+        }
+
+        buf->retrieve(lengthFieldSize_);
+        // 直接把Buffer中的数据交给用户，回调结束后再回收
+        frameCallback_(conn, buf->peek(), static_cast<size_t>(len), receiveTime);
+        buf->retrieve(static_cast<size_t>(len));
+        needed = lengthFieldSize_;
+    }
+
+    if (useRecvLowat_ && conn->connected())
+    {
+        // 剩余部分到达之前不再唤醒loop，读满消息后恢复为1
+        size_t remaining = needed > buf->readableBytes() ? needed - buf->readableBytes() : 1;
+        conn->setRecvLowat(static_cast<int>(std::min(remaining, static_cast<size_t>(kMaxRecvLowat))));
+    }
+}
+
+bool LengthFieldCodec::checkSendLength(const TcpConnectionPtr &conn, size_t len) const
+{
+    // 超过长度头能表示的范围时长度会被截断 对端会按错误的长度拆包
+    bool fits = lengthFieldSize_ >= sizeof(uint64_t) || len < (static_cast<uint64_t>(1) << (lengthFieldSize_ * 8));
+    if (len > maxFrameLength_ || !fits)
+    {
+        LOG_ERROR("LengthFieldCodec %s frame length %lu too long to send \n", conn->name().c_str(), len);
+        return false;
+    }
+    return true;
+}
+
+void LengthFieldCodec::send(const TcpConnectionPtr &conn, Buffer *body) const
+{
+    if (!checkSendLength(conn, body->readableBytes()))
+    {
+        body->retrieveAll();
+        return;
+    }
+    prependLength(body, body->readableBytes());
+    conn->send(body);
+}
+
+void LengthFieldCodec::send(const TcpConnectionPtr &conn, const void *data, size_t len) const
+{
+    if (!checkSendLength(conn, len))
+    {
+        return;
+    }
+    Buffer buf;
+    buf.append(static_cast<const char *>(data), len);
+    prependLength(&buf, len);
+    conn->send(&buf);
+}
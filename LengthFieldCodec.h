@@ -0,0 +1,55 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Timestamp.h"
+
+#include <functional>
+
+/*
+长度前缀的消息编解码器 头部是网络字节序的消息体长度(1/2/4/8字节)
+解码: 完整的消息直接以指针+长度的形式交给回调，不拷贝Buffer中的数据
+编码: 长度头写进Buffer的kCheapPrepend预留区，头部和消息体一次发送
+*/
+class LengthFieldCodec : noncopyable
+{
+public:
+    // data指向inputBuffer中的消息体，只在回调期间有效
+    using FrameCallback = std::function<void(const TcpConnectionPtr &,
+                                             const char *data,
+                                             size_t len,
+                                             Timestamp)>;
+    // 消息长度超过上限时的回调，默认直接关闭连接
+    using ErrorCallback = std::function<void(const TcpConnectionPtr &, uint64_t frameLength)>;
+
+    static const size_t kDefaultMaxFrameLength = 16 * 1024 * 1024;
+    // SO_RCVLOWAT的上限，内核会把它限制在接收缓冲区的一半以内
+    static const int kMaxRecvLowat = 64 * 1024;
+
+    explicit LengthFieldCodec(const FrameCallback &cb,
+                              size_t lengthFieldSize = 4,
+                              size_t maxFrameLength = kDefaultMaxFrameLength);
+
+    void setErrorCallback(const ErrorCallback &cb) { errorCallback_ = cb; }
+    // 收到不完整的消息时用SO_RCVLOWAT推迟唤醒，直到剩余部分到达
+    void setUseRecvLowat(bool on) { useRecvLowat_ = on; }
+
+    // 作为TcpServer/TcpClient的MessageCallback
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+    // 在body前面写入长度头后发送，body会被清空
+    // 长度超过上限或长度头放不下时不发送，记录错误日志
+    void send(const TcpConnectionPtr &conn, Buffer *body) const;
+    void send(const TcpConnectionPtr &conn, const void *data, size_t len) const;
+
+private:
+    uint64_t peekLength(const Buffer *buf) const;
+    void prependLength(Buffer *buf, uint64_t len) const;
+    bool checkSendLength(const TcpConnectionPtr &conn, size_t len) const;
+
+    FrameCallback frameCallback_;
+    ErrorCallback errorCallback_;
+    const size_t lengthFieldSize_;
+    const size_t maxFrameLength_;
+    bool useRecvLowat_;
+};
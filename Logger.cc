@@ -1,7 +1,31 @@
 #include "Logger.h"
 #include "Timestamp.h"
 
+#include <algorithm>
 #include <iostream>
+#include <string.h>
+
+namespace
+{
+// 每个线程缓存上一次格式化的日期时间 同一秒内的日志直接复用 不再走localtime_r+snprintf
+thread_local time_t t_lastSecond = -1;
+thread_local char t_time[32];
+thread_local size_t t_timeLen = 0;
+
+const char *formatTime(Timestamp now, size_t *len)
+{
+    time_t seconds = now.secondsSinceEpoch();
+    if (seconds != t_lastSecond)
+    {
+        t_lastSecond = seconds;
+        std::string formatted = now.toString();
+        t_timeLen = std::min(formatted.size(), sizeof t_time - 1);
+        memcpy(t_time, formatted.data(), t_timeLen);
+    }
+    *len = t_timeLen;
+    return t_time;
+}
+} // namespace
 
 Logger &Logger::instance()
 {
@@ -36,5 +60,8 @@ void Logger::log(std::string msg)
     }
 
     // 打印时间和msg
-    std::cout << Timestamp::now().toString() << " : " << msg << std::endl;
+    size_t len = 0;
+    const char *timeStr = formatTime(Timestamp::now(), &len);
+    std::cout.write(timeStr, len);
+    std::cout << " : " << msg << std::endl;
 }
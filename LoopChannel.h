@@ -0,0 +1,134 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "EventLoop.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// EventLoop在每轮循环结束时排空登记在它上面的所有入站通道
+class LoopChannelBase : noncopyable
+{
+public:
+    virtual ~LoopChannelBase() = default;
+    // 只在消费者loop线程中调用 返回本次处理的消息数
+    virtual size_t drain() = 0;
+    bool closed() const { return closed_.load(std::memory_order_acquire); }
+
+protected:
+    LoopChannelBase() : closed_(false) {}
+    std::atomic_bool closed_;
+};
+
+/*
+两个EventLoop之间的单生产者单消费者无锁环形通道
+生产者线程push，消息在消费者loop每轮循环结束时批量处理，不经过queueInLoop的互斥锁和std::function
+消费者排空之前生产者只会写一次eventfd，一批消息只唤醒一次
+生产者和消费者各自的下标放在不同的缓存行上，避免伪共享
+T需要可以默认构造和移动赋值
+*/
+template <typename T>
+class LoopChannel : public LoopChannelBase
+{
+public:
+    using Handler = std::function<void(T &)>;
+    using Ptr = std::shared_ptr<LoopChannel<T>>;
+
+    // 创建一个通往consumer的通道 capacity向上取整为2的幂，handler在consumer线程中执行 可以在任意线程调用
+    static Ptr create(EventLoop *consumer, size_t capacity, Handler handler)
+    {
+        Ptr channel(new LoopChannel<T>(consumer, capacity, std::move(handler)));
+        consumer->runInLoop([consumer, channel]()
+                            { consumer->addLoopChannel(channel); });
+        return channel;
+    }
+
+    // 只能在唯一的生产者线程中调用 通道满时返回false，由调用方决定重试还是丢弃
+    bool push(T item)
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cachedHead_ >= slots_.size())
+        {
+            cachedHead_ = head_.load(std::memory_order_acquire);
+            if (tail - cachedHead_ >= slots_.size())
+            {
+                return false;
+            }
+        }
+        slots_[tail & mask_] = std::move(item);
+        tail_.store(tail + 1, std::memory_order_seq_cst);
+        // 消费者清除signaled_之后才读取tail_，所以这里看到true时新消息一定会在这次排空中被处理
+        if (!signaled_.exchange(true, std::memory_order_seq_cst))
+        {
+            consumer_->wakeup();
+        }
+        return true;
+    }
+
+    // 消费者不再处理这个通道 已经在通道里的消息会被丢弃
+    void close() { closed_.store(true, std::memory_order_release); }
+
+    size_t capacity() const { return slots_.size(); }
+    EventLoop *consumer() const { return consumer_; }
+
+    size_t drain() override
+    {
+        if (!signaled_.load(std::memory_order_relaxed))
+        {
+            return 0;
+        }
+        signaled_.store(false, std::memory_order_seq_cst);
+
+        // 只处理此刻已经发布的消息 之后到达的消息会重新唤醒
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t tail = tail_.load(std::memory_order_seq_cst);
+        for (size_t i = head; i != tail; ++i)
+        {
+            handler_(slots_[i & mask_]);
+            slots_[i & mask_] = T();
+        }
+        head_.store(tail, std::memory_order_release);
+        return tail - head;
+    }
+
+private:
+    LoopChannel(EventLoop *consumer, size_t capacity, Handler handler)
+        : consumer_(consumer),
+          handler_(std::move(handler)),
+          slots_(roundUpPowerOfTwo(capacity)),
+          mask_(slots_.size() - 1),
+          head_(0),
+          tail_(0),
+          cachedHead_(0),
+          signaled_(false)
+    {
+    }
+
+    static size_t roundUpPowerOfTwo(size_t n)
+    {
+        size_t size = 2;
+        while (size < n)
+        {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    static const size_t kCacheLine = 64;
+
+    EventLoop *consumer_;
+    Handler handler_;
+    std::vector<T> slots_;
+    size_t mask_;
+
+    char pad0_[kCacheLine];
+    std::atomic<size_t> head_; // 消费者写 生产者读
+    char pad1_[kCacheLine];
+    std::atomic<size_t> tail_; // 生产者写 消费者读
+    size_t cachedHead_;        // 生产者缓存的head_ 只在确认通道满时才重新读取
+    char pad2_[kCacheLine];
+    std::atomic_bool signaled_; // 消费者排空之前只唤醒一次
+    char pad3_[kCacheLine];
+};
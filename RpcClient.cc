@@ -0,0 +1,144 @@
+#include "RpcClient.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+RpcClient::RpcClient(EventLoop *loop, const InetAddress &serverAddr, const std::string &name)
+    : loop_(loop),
+      client_(loop, serverAddr, name),
+      codec_(std::bind(&RpcClient::onRpcMessage, this,
+                       std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4)),
+      nextRequestId_(1)
+{
+    client_.setConnectionCallback(std::bind(&RpcClient::onConnection, this, std::placeholders::_1));
+    client_.setMessageCallback(std::bind(&RpcCodec::onMessage, &codec_,
+                                         std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+RpcClient::~RpcClient()
+{
+    for (auto &entry : pending_)
+    {
+        if (entry.second.hasTimer)
+        {
+            loop_->cancel(entry.second.timer);
+        }
+    }
+}
+
+void RpcClient::call(uint16_t methodId, const void *data, size_t len, const ResponseCallback &cb, double timeout)
+{
+    RpcHeader header;
+    header.requestId = nextRequestId_++;
+    header.methodId = methodId;
+    header.type = RpcHeader::kRequest;
+    header.status = kRpcOk;
+
+    if (loop_->isInLoopThread())
+    {
+        Buffer buf;
+        RpcCodec::encode(&buf, header, data, len);
+        callInLoop(header.requestId, &buf, cb, timeout);
+    }
+    else
+    {
+        // 在调用者线程中完成编码
+        std::shared_ptr<Buffer> buf(new Buffer);
+        RpcCodec::encode(buf.get(), header, data, len);
+        uint64_t requestId = header.requestId;
+        loop_->runInLoop([this, requestId, buf, cb, timeout]()
+                         { callInLoop(requestId, buf.get(), cb, timeout); });
+    }
+}
+
+void RpcClient::callInLoop(uint64_t requestId, Buffer *request, const ResponseCallback &cb, double timeout)
+{
+    PendingCall &call = pending_[requestId];
+    call.cb = cb;
+    call.hasTimer = timeout > 0;
+    if (call.hasTimer)
+    {
+        call.timer = loop_->runAfter(timeout, std::bind(&RpcClient::onTimeout, this, requestId));
+    }
+
+    if (conn_ && conn_->connected())
+    {
+        conn_->send(request);
+    }
+    else
+    {
+        unsent_.append(request->peek(), request->readableBytes());
+    }
+}
+
+void RpcClient::onConnection(const TcpConnectionPtr &conn)
+{
+    LOG_DEBUG("RpcClient - %s -> %s is %s \n", conn->localAddress().toIpPort().c_str(),
+              conn->peerAddress().toIpPort().c_str(), conn->connected() ? "UP" : "DOWN");
+
+    if (conn->connected())
+    {
+        conn_ = conn;
+        if (unsent_.readableBytes() > 0)
+        {
+            conn_->send(&unsent_);
+        }
+    }
+    else
+    {
+        conn_.reset();
+        failAll(kRpcConnectionClosed);
+    }
+}
+
+void RpcClient::onRpcMessage(const TcpConnectionPtr &conn, const RpcHeader &header, const char *body, Timestamp)
+{
+    if (header.type != RpcHeader::kResponse)
+    {
+        LOG_ERROR("RpcClient %s unexpected request message \n", conn->name().c_str());
+        conn->forceClose();
+        return;
+    }
+
+    PendingMap::iterator it = pending_.find(header.requestId);
+    if (it == pending_.end())
+    {
+        // 已经超时的调用，丢弃迟到的响应
+        return;
+    }
+    if (it->second.hasTimer)
+    {
+        loop_->cancel(it->second.timer);
+    }
+    ResponseCallback cb;
+    cb.swap(it->second.cb);
+    pending_.erase(it);
+    cb(static_cast<RpcStatus>(header.status), body, header.length);
+}
+
+void RpcClient::onTimeout(uint64_t requestId)
+{
+    PendingMap::iterator it = pending_.find(requestId);
+    if (it == pending_.end())
+    {
+        return;
+    }
+    ResponseCallback cb;
+    cb.swap(it->second.cb);
+    pending_.erase(it);
+    cb(kRpcTimeout, nullptr, 0);
+}
+
+void RpcClient::failAll(RpcStatus status)
+{
+    unsent_.retrieveAll();
+    PendingMap calls;
+    calls.swap(pending_);
+    for (auto &entry : calls)
+    {
+        if (entry.second.hasTimer)
+        {
+            loop_->cancel(entry.second.timer);
+        }
+        entry.second.cb(status, nullptr, 0);
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "TcpClient.h"
+#include "RpcCodec.h"
+#include "TimerId.h"
+#include "Buffer.h"
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <atomic>
+
+/*
+基于TcpClient的多路复用RPC客户端 所有调用共享同一个连接
+每个调用分配唯一的requestId，响应按requestId匹配，可以乱序返回
+*/
+class RpcClient : noncopyable
+{
+public:
+    // 在loop线程中执行 data指向inputBuffer中的响应体，只在回调期间有效
+    using ResponseCallback = std::function<void(RpcStatus status, const char *data, size_t len)>;
+
+    RpcClient(EventLoop *loop, const InetAddress &serverAddr, const std::string &name);
+    ~RpcClient();
+
+    void connect() { client_.connect(); }
+    void disconnect() { client_.disconnect(); }
+    void enableRetry() { client_.enableRetry(); }
+
+    // 可以在任意线程调用 连接建立之前的调用会暂存，连接建立后一起发送
+    // timeout为超时时间(秒)，小于等于0表示不超时
+    void call(uint16_t methodId, const void *data, size_t len, const ResponseCallback &cb, double timeout = 0);
+    void call(uint16_t methodId, const std::string &request, const ResponseCallback &cb, double timeout = 0)
+    {
+        call(methodId, request.data(), request.size(), cb, timeout);
+    }
+
+    EventLoop *getLoop() const { return loop_; }
+    // 只能在loop线程中调用
+    size_t pendingCalls() const { return pending_.size(); }
+
+private:
+    struct PendingCall
+    {
+        ResponseCallback cb;
+        TimerId timer;
+        bool hasTimer;
+    };
+    using PendingMap = std::unordered_map<uint64_t, PendingCall>;
+
+    void callInLoop(uint64_t requestId, Buffer *request, const ResponseCallback &cb, double timeout);
+    void onConnection(const TcpConnectionPtr &conn);
+    void onRpcMessage(const TcpConnectionPtr &conn, const RpcHeader &header, const char *body, Timestamp receiveTime);
+    void onTimeout(uint64_t requestId);
+    // 连接断开时所有未完成的调用以kRpcConnectionClosed结束
+    void failAll(RpcStatus status);
+
+    EventLoop *loop_;
+    TcpClient client_;
+    RpcCodec codec_;
+    std::atomic<uint64_t> nextRequestId_;
+    TcpConnectionPtr conn_; // 只在loop线程中访问
+    Buffer unsent_;         // 连接建立之前的请求
+    PendingMap pending_;
+};
@@ -0,0 +1,62 @@
+#include "RpcCodec.h"
+#include "TcpConnection.h"
+#include "Buffer.h"
+#include "Logger.h"
+
+const size_t RpcCodec::kHeaderLen;
+const size_t RpcCodec::kDefaultMaxBodyLength;
+
+RpcCodec::RpcCodec(const RpcMessageCallback &cb, size_t maxBodyLength)
+    : messageCallback_(cb),
+      maxBodyLength_(maxBodyLength)
+{
+}
+
+void RpcCodec::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+{
+    while (buf->readableBytes() >= kHeaderLen && conn->connected())
+    {
+        uint32_t length = static_cast<uint32_t>(buf->peekInt32());
+        if (length > maxBodyLength_)
+        {
+            LOG_ERROR("RpcCodec %s invalid body length %u \n", conn->name().c_str(), length);
+            conn->forceClose();
+            buf->retrieveAll();
+            return;
+        }
+        if (buf->readableBytes() < kHeaderLen + length)
+        {
+            break;
+        }
+
+        RpcHeader header;
+        header.length = static_cast<uint32_t>(buf->readInt32());
+        header.requestId = static_cast<uint64_t>(buf->readInt64());
+        header.methodId = static_cast<uint16_t>(buf->readInt16());
+        header.type = static_cast<uint8_t>(buf->readInt8());
+        header.status = static_cast<uint8_t>(buf->readInt8());
+        if (header.type != RpcHeader::kRequest && header.type != RpcHeader::kResponse)
+        {
+            LOG_ERROR("RpcCodec %s invalid message type %d \n", conn->name().c_str(), header.type);
+            conn->forceClose();
+            buf->retrieveAll();
+            return;
+        }
+
+        // body不拷贝，回调结束后再回收
+        messageCallback_(conn, header, buf->peek(), receiveTime);
+        buf->retrieve(header.length);
+    }
+}
+
+void RpcCodec::encode(Buffer *out, RpcHeader header, const void *body, size_t len)
+{
+    header.length = static_cast<uint32_t>(len);
+    out->ensureWriteableBytes(kHeaderLen + len);
+    out->appendInt32(static_cast<int32_t>(header.length));
+    out->appendInt64(static_cast<int64_t>(header.requestId));
+    out->appendInt16(static_cast<int16_t>(header.methodId));
+    out->appendInt8(static_cast<int8_t>(header.type));
+    out->appendInt8(static_cast<int8_t>(header.status));
+    out->append(static_cast<const char *>(body), len);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Timestamp.h"
+
+#include <functional>
+#include <stdint.h>
+
+class Buffer;
+
+// 调用结果 kRpcTimeout和kRpcConnectionClosed只在客户端本地产生，不会出现在网络上
+enum RpcStatus : uint8_t
+{
+    kRpcOk = 0,
+    kRpcNoSuchMethod = 1, // 服务端没有注册该方法
+    kRpcError = 2,        // 方法执行失败，body为错误信息
+    kRpcBusy = 3,         // 服务端工作线程池队列已满
+    kRpcTimeout = 4,
+    kRpcConnectionClosed = 5,
+};
+
+/*
+RPC消息头 16字节 网络字节序
+| length(4) | requestId(8) | methodId(2) | type(1) | status(1) | body(length) |
+同一个连接上的多个调用用requestId区分，响应可以以任意顺序返回
+*/
+struct RpcHeader
+{
+    enum Type : uint8_t
+    {
+        kRequest = 0,
+        kResponse = 1,
+    };
+
+    uint32_t length;
+    uint64_t requestId;
+    uint16_t methodId;
+    uint8_t type;
+    uint8_t status;
+};
+
+class RpcCodec : noncopyable
+{
+public:
+    // body指向inputBuffer中的数据，只在回调期间有效
+    using RpcMessageCallback = std::function<void(const TcpConnectionPtr &,
+                                                  const RpcHeader &,
+                                                  const char *body,
+                                                  Timestamp)>;
+
+    static const size_t kHeaderLen = 16;
+    static const size_t kDefaultMaxBodyLength = 16 * 1024 * 1024;
+
+    explicit RpcCodec(const RpcMessageCallback &cb, size_t maxBodyLength = kDefaultMaxBodyLength);
+
+    // 作为TcpServer/TcpClient的MessageCallback 格式错误时关闭连接
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+    // 把消息头和body追加到out中，header.length由len决定 可以在任意线程调用
+    static void encode(Buffer *out, RpcHeader header, const void *body, size_t len);
+
+private:
+    RpcMessageCallback messageCallback_;
+    const size_t maxBodyLength_;
+};
@@ -0,0 +1,113 @@
+#include "RpcServer.h"
+#include "Logger.h"
+
+RpcServer::RpcServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &name, TcpServer::Option option)
+    : loop_(loop),
+      server_(loop, listenAddr, name, option),
+      codec_(std::bind(&RpcServer::onRpcMessage, this,
+                       std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4)),
+      workers_(name + "-worker"),
+      workerThreadNum_(0)
+{
+    server_.setConnectionCallback(std::bind(&RpcServer::onConnection, this, std::placeholders::_1));
+    server_.setMessageCallback(std::bind(&RpcCodec::onMessage, &codec_,
+                                         std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+RpcServer::~RpcServer()
+{
+    workers_.stop();
+}
+
+void RpcServer::registerMethod(uint16_t methodId, const MethodHandler &handler, ExecutionMode mode)
+{
+    Method method;
+    method.handler = handler;
+    method.mode = mode;
+    methods_[methodId] = method;
+}
+
+void RpcServer::start()
+{
+    if (workerThreadNum_ > 0)
+    {
+        workers_.start(workerThreadNum_);
+    }
+    server_.start();
+}
+
+void RpcServer::onConnection(const TcpConnectionPtr &conn)
+{
+    LOG_INFO("RpcServer - %s -> %s is %s \n", conn->peerAddress().toIpPort().c_str(),
+             conn->localAddress().toIpPort().c_str(), conn->connected() ? "UP" : "DOWN");
+}
+
+void RpcServer::onRpcMessage(const TcpConnectionPtr &conn, const RpcHeader &header, const char *body, Timestamp)
+{
+    if (header.type != RpcHeader::kRequest)
+    {
+        LOG_ERROR("RpcServer %s unexpected response message \n", conn->name().c_str());
+        conn->forceClose();
+        return;
+    }
+
+    std::weak_ptr<TcpConnection> weakConn(conn);
+    MethodMap::const_iterator it = methods_.find(header.methodId);
+    if (it == methods_.end())
+    {
+        sendReply(weakConn, header.requestId, header.methodId, kRpcNoSuchMethod, nullptr, 0);
+        return;
+    }
+
+    RpcReply reply = std::bind(&RpcServer::sendReply, weakConn, header.requestId, header.methodId,
+                               std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
+    const Method &method = it->second;
+    if (method.mode == kInline || workerThreadNum_ <= 0)
+    {
+        method.handler(conn, body, header.length, reply);
+        return;
+    }
+
+    // 请求体在inputBuffer中，回调返回后就会被回收，交给工作线程前必须拷贝
+    std::shared_ptr<std::string> request(new std::string(body, header.length));
+    const MethodHandler &handler = method.handler;
+    bool queued = workers_.trySubmit([conn, request, reply, &handler]()
+                                     { handler(conn, request->data(), request->size(), reply); });
+    if (!queued)
+    {
+        reply(kRpcBusy, nullptr, 0);
+    }
+}
+
+void RpcServer::sendReply(const std::weak_ptr<TcpConnection> &weakConn, uint64_t requestId, uint16_t methodId,
+                          RpcStatus status, const void *data, size_t len)
+{
+    TcpConnectionPtr conn = weakConn.lock();
+    if (!conn)
+    {
+        // 连接已经断开，丢弃响应
+        return;
+    }
+
+    RpcHeader header;
+    header.requestId = requestId;
+    header.methodId = methodId;
+    header.type = RpcHeader::kResponse;
+    header.status = status;
+
+    EventLoop *loop = conn->getLoop();
+    if (loop->isInLoopThread())
+    {
+        Buffer buf;
+        RpcCodec::encode(&buf, header, data, len);
+        conn->send(&buf);
+    }
+    else
+    {
+        // 在工作线程中完成编码，IO线程只负责发送
+        std::shared_ptr<Buffer> buf(new Buffer);
+        RpcCodec::encode(buf.get(), header, data, len);
+        loop->runInLoop([conn, buf]()
+                        { conn->send(buf.get()); });
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "TcpServer.h"
+#include "RpcCodec.h"
+#include "ComputePool.h"
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+/*
+基于TcpServer的多路复用RPC服务端
+一个连接上可以同时有多个调用，每个调用用requestId标识，先完成的先回复，没有队头阻塞
+方法按methodId注册，可以选择直接在IO线程中执行或者交给工作线程池执行
+*/
+class RpcServer : noncopyable
+{
+public:
+    // 回复一次调用 可以在任意线程中调用，也可以在handler返回后异步调用，每个调用只能回复一次
+    using RpcReply = std::function<void(RpcStatus status, const void *data, size_t len)>;
+    // data只在handler执行期间有效，异步回复时需要自己拷贝
+    using MethodHandler = std::function<void(const TcpConnectionPtr &,
+                                             const char *data,
+                                             size_t len,
+                                             const RpcReply &reply)>;
+
+    enum ExecutionMode
+    {
+        kInline,     // 在IO线程中执行，适合不阻塞的短任务
+        kWorkerPool, // 请求体拷贝后交给工作线程池执行，结果通过runInLoop送回IO线程
+    };
+
+    RpcServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &name,
+              TcpServer::Option option = TcpServer::kNoReusePort);
+    ~RpcServer();
+
+    EventLoop *getLoop() const { return loop_; }
+
+    // 以下设置都必须在start之前调用
+    void setThreadNum(int numThreads) { server_.setThreadNum(numThreads); }
+    void setWorkerThreadNum(int numThreads) { workerThreadNum_ = numThreads; }
+    // 工作线程池队列满时新的调用直接回复kRpcBusy
+    void setMaxWorkerQueueSize(size_t maxSize) { workers_.setMaxQueueSize(maxSize); }
+    void registerMethod(uint16_t methodId, const MethodHandler &handler, ExecutionMode mode = kInline);
+
+    void start();
+
+private:
+    struct Method
+    {
+        MethodHandler handler;
+        ExecutionMode mode;
+    };
+    using MethodMap = std::unordered_map<uint16_t, Method>;
+
+    void onConnection(const TcpConnectionPtr &conn);
+    void onRpcMessage(const TcpConnectionPtr &conn, const RpcHeader &header, const char *body, Timestamp receiveTime);
+
+    static void sendReply(const std::weak_ptr<TcpConnection> &weakConn, uint64_t requestId, uint16_t methodId,
+                          RpcStatus status, const void *data, size_t len);
+
+    EventLoop *loop_;
+    TcpServer server_;
+    RpcCodec codec_;
+    MethodMap methods_; // start之后只读，多个IO线程并发查找不需要加锁
+    ComputePool workers_;
+    int workerThreadNum_;
+};
@@ -7,6 +7,7 @@
 #include <sys/types.h>
 #include <strings.h>
 #include <netinet/tcp.h>
+#include <errno.h>
 
 Socket::~Socket()
 {
@@ -15,28 +16,28 @@ Socket::~Socket()
 
 void Socket::bindAddress(const InetAddress &localaddr)
 {
-    if (::bind(sockfd_, (sockaddr *)localaddr.getSockAddr(), sizeof(sockaddr_in)) != 0)
+    if (::bind(sockfd_, localaddr.getSockAddr(), localaddr.getSockLen()) != 0)
     {
         LOG_FATAL("bind sockfd:%d fail \n", sockfd_);
     }
 }
 
-void Socket::listen()
+void Socket::listen(int backlog)
 {
-    if (::listen(sockfd_, 1024) != 0)
+    if (::listen(sockfd_, backlog > 0 ? backlog : SOMAXCONN) != 0)
     {
         LOG_FATAL("listen sockfd:%d fail \n", sockfd_);
     }
 }
 int Socket::accept(InetAddress *peeraddr)
 {
-    sockaddr_in addr;
+    sockaddr_un addr; // 足够放下IPv4/IPv6/Unix域地址
     socklen_t len = sizeof addr; // 要初始化
     bzero(&addr, sizeof addr);
     int connfd = ::accept4(sockfd_, (sockaddr *)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
     if (connfd >= 0)
     {
-        peeraddr->setSockAddrInet(addr);
+        peeraddr->setSockAddr((sockaddr *)&addr, len);
     }
     return connfd;
 }
@@ -71,4 +72,84 @@ void Socket::setKeepalive(bool on)
 {
     int optval = on ? 1 : 0;
     ::setsockopt(sockfd_, SOL_SOCKET, SO_KEEPALIVE, &optval, sizeof optval);
-}
\ No newline at end of file
+}
+
+void Socket::setRecvLowat(int bytes)
+{
+    int optval = bytes > 0 ? bytes : 1;
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_RCVLOWAT, &optval, sizeof optval) < 0)
+    {
+        LOG_ERROR("setsockopt SO_RCVLOWAT fd=%d err:%d \n", sockfd_, errno);
+    }
+}
+
+// 设置整数类型的socket选项 失败时记录日志
+static void setIntOption(int sockfd, int level, int name, int value, const char *what)
+{
+    if (::setsockopt(sockfd, level, name, &value, sizeof value) < 0)
+    {
+        LOG_ERROR("setsockopt %s fd=%d err:%d \n", what, sockfd, errno);
+    }
+}
+
+void Socket::setDeferAccept(int seconds)
+{
+    setIntOption(sockfd_, IPPROTO_TCP, TCP_DEFER_ACCEPT, seconds, "TCP_DEFER_ACCEPT");
+}
+
+void Socket::setFastOpen(int queueLen)
+{
+    setIntOption(sockfd_, IPPROTO_TCP, TCP_FASTOPEN, queueLen, "TCP_FASTOPEN");
+}
+
+void Socket::setRecvBufferSize(int bytes)
+{
+    setIntOption(sockfd_, SOL_SOCKET, SO_RCVBUF, bytes, "SO_RCVBUF");
+}
+
+void Socket::setSendBufferSize(int bytes)
+{
+    setIntOption(sockfd_, SOL_SOCKET, SO_SNDBUF, bytes, "SO_SNDBUF");
+}
+
+void Socket::setQuickAck(bool on)
+{
+    setIntOption(sockfd_, IPPROTO_TCP, TCP_QUICKACK, on ? 1 : 0, "TCP_QUICKACK");
+}
+
+void Socket::setUserTimeout(int ms)
+{
+    setIntOption(sockfd_, IPPROTO_TCP, TCP_USER_TIMEOUT, ms, "TCP_USER_TIMEOUT");
+}
+
+void Socket::applyListenOptions(const SocketOptions &options)
+{
+    if (options.deferAcceptSeconds > 0)
+    {
+        setDeferAccept(options.deferAcceptSeconds);
+    }
+    if (options.fastOpenQueueLen > 0)
+    {
+        setFastOpen(options.fastOpenQueueLen);
+    }
+    if (options.recvBufferSize > 0)
+    {
+        setRecvBufferSize(options.recvBufferSize);
+    }
+    if (options.sendBufferSize > 0)
+    {
+        setSendBufferSize(options.sendBufferSize);
+    }
+    if (options.tcpNoDelay)
+    {
+        setTcpNoDelay(true);
+    }
+    if (options.keepAlive)
+    {
+        setKeepalive(true);
+    }
+    if (options.userTimeoutMs > 0)
+    {
+        setUserTimeout(options.userTimeoutMs);
+    }
+}
@@ -4,6 +4,38 @@
 
 class InetAddress;
 
+/*
+TcpServer的socket参数
+Linux上accept出来的连接会继承监听socket的缓冲区大小、TCP_NODELAY、TCP_USER_TIMEOUT和SO_KEEPALIVE，
+这些参数只在监听socket上设置一次；TCP_QUICKACK不会继承，在每个连接上设置
+数值参数小于等于0表示保持系统默认值
+*/
+struct SocketOptions
+{
+    SocketOptions()
+        : backlog(1024),
+          deferAcceptSeconds(0),
+          fastOpenQueueLen(0),
+          recvBufferSize(0),
+          sendBufferSize(0),
+          tcpNoDelay(false),
+          keepAlive(false),
+          userTimeoutMs(0),
+          quickAck(false)
+    {
+    }
+
+    int backlog;
+    int deferAcceptSeconds; // TCP_DEFER_ACCEPT 收到数据(或超时)后才唤醒accept
+    int fastOpenQueueLen;   // TCP_FASTOPEN 等待完成握手的TFO请求队列长度
+    int recvBufferSize;     // SO_RCVBUF 必须在listen之前设置才能影响窗口扩大因子
+    int sendBufferSize;     // SO_SNDBUF
+    bool tcpNoDelay;
+    bool keepAlive;
+    int userTimeoutMs; // TCP_USER_TIMEOUT 发送的数据超过这个时间没有被确认就断开
+    bool quickAck;     // TCP_QUICKACK 每个新连接上设置，每次读完数据后重新设置
+};
+
 // 封装socket fd
 class Socket : noncopyable
 {
@@ -16,7 +48,7 @@ public:
 
     int fd() const { return sockfd_; }
     void bindAddress(const InetAddress &localadr);
-    void listen();
+    void listen(int backlog = 1024);
     int accept(InetAddress *peeraddr);
 
     void shutdownWrite();
@@ -24,6 +56,16 @@ public:
     void setReuseAddr(bool on);
     void setReusePort(bool on);
     void setKeepalive(bool on);
+    // 接收缓冲区中至少有bytes字节时才通知可读
+    void setRecvLowat(int bytes);
+    void setDeferAccept(int seconds);
+    void setFastOpen(int queueLen);
+    void setRecvBufferSize(int bytes);
+    void setSendBufferSize(int bytes);
+    void setQuickAck(bool on);
+    void setUserTimeout(int ms);
+    // 在监听socket上应用listen之前需要设置的参数
+    void applyListenOptions(const SocketOptions &options);
 
 private:
     const int sockfd_;
@@ -0,0 +1,243 @@
+#include "SocketHandoff.h"
+#include "Logger.h"
+#include "Buffer.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+const size_t SocketHandoff::kMaxChunk;
+
+static bool fillUnixAddr(const std::string &path, sockaddr_un *addr)
+{
+    memset(addr, 0, sizeof *addr);
+    addr->sun_family = AF_UNIX;
+    if (path.size() >= sizeof addr->sun_path)
+    {
+        LOG_ERROR("SocketHandoff path too long: %s \n", path.c_str());
+        return false;
+    }
+    memcpy(addr->sun_path, path.data(), path.size());
+    return true;
+}
+
+int SocketHandoff::listen(const std::string &path)
+{
+    sockaddr_un addr;
+    if (!fillUnixAddr(path, &addr))
+    {
+        return -1;
+    }
+    int fd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        LOG_ERROR("SocketHandoff::listen socket err:%d \n", errno);
+        return -1;
+    }
+    ::unlink(path.c_str()); // 上一次重启留下的路径
+    if (::bind(fd, (sockaddr *)&addr, sizeof addr) < 0 || ::listen(fd, 1) < 0)
+    {
+        LOG_ERROR("SocketHandoff::listen %s err:%d \n", path.c_str(), errno);
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int SocketHandoff::connect(const std::string &path)
+{
+    sockaddr_un addr;
+    if (!fillUnixAddr(path, &addr))
+    {
+        return -1;
+    }
+    int fd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (::connect(fd, (sockaddr *)&addr, sizeof addr) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+SocketHandoff::SocketHandoff(int sockfd)
+    : sockfd_(sockfd)
+{
+}
+
+SocketHandoff::~SocketHandoff()
+{
+    ::close(sockfd_);
+}
+
+bool SocketHandoff::sendMessage(uint8_t type, const void *data, size_t len, int fd)
+{
+    struct iovec vec[2];
+    vec[0].iov_base = &type;
+    vec[0].iov_len = sizeof type;
+    vec[1].iov_base = const_cast<void *>(data);
+    vec[1].iov_len = len;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = vec;
+    msg.msg_iovlen = len > 0 ? 2 : 1;
+
+    char control[CMSG_SPACE(sizeof(int))];
+    if (fd >= 0)
+    {
+        memset(control, 0, sizeof control);
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof control;
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof fd);
+    }
+
+    ssize_t n;
+    do
+    {
+        n = ::sendmsg(sockfd_, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+    {
+        LOG_ERROR("SocketHandoff::sendMessage type:%d err:%d \n", type, errno);
+        return false;
+    }
+    return true;
+}
+
+ssize_t SocketHandoff::recvMessage(uint8_t *type, char *data, size_t len, int *fd)
+{
+    struct iovec vec[2];
+    vec[0].iov_base = type;
+    vec[0].iov_len = sizeof *type;
+    vec[1].iov_base = data;
+    vec[1].iov_len = len;
+
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = vec;
+    msg.msg_iovlen = 2;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+
+    ssize_t n;
+    do
+    {
+        n = ::recvmsg(sockfd_, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0)
+    {
+        return -1;
+    }
+
+    *fd = -1;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            memcpy(fd, CMSG_DATA(cmsg), sizeof *fd);
+        }
+    }
+    return n - 1;
+}
+
+bool SocketHandoff::sendListenSocket(int listenfd)
+{
+    return sendMessage(kListenSocket, nullptr, 0, listenfd);
+}
+
+bool SocketHandoff::sendConnection(int connfd, const std::string &input, const std::string &output)
+{
+    Buffer header;
+    header.appendInt64(static_cast<int64_t>(input.size()));
+    header.appendInt64(static_cast<int64_t>(output.size()));
+    if (!sendMessage(kConnection, header.peek(), header.readableBytes(), connfd))
+    {
+        return false;
+    }
+
+    const std::string *parts[] = {&input, &output};
+    for (const std::string *part : parts)
+    {
+        for (size_t off = 0; off < part->size(); off += kMaxChunk)
+        {
+            size_t len = std::min(kMaxChunk, part->size() - off);
+            if (!sendMessage(kConnectionData, part->data() + off, len, -1))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool SocketHandoff::sendDone()
+{
+    return sendMessage(kDone, nullptr, 0, -1);
+}
+
+bool SocketHandoff::receive(Message *msg)
+{
+    std::vector<char> data(kMaxChunk);
+    uint8_t type = 0;
+    int fd = -1;
+    ssize_t n = recvMessage(&type, data.data(), data.size(), &fd);
+    if (n < 0)
+    {
+        return false;
+    }
+
+    msg->type = type;
+    msg->fd = fd;
+    msg->input.clear();
+    msg->output.clear();
+    if (type != kConnection)
+    {
+        return true;
+    }
+
+    if (n != 16 || fd < 0)
+    {
+        LOG_ERROR("SocketHandoff::receive bad connection message \n");
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+        return false;
+    }
+    Buffer header;
+    header.append(data.data(), n);
+    size_t inputLen = static_cast<size_t>(header.readInt64());
+    size_t outputLen = static_cast<size_t>(header.readInt64());
+    msg->input.reserve(inputLen);
+    msg->output.reserve(outputLen);
+
+    // 接收缓冲区分片 先填满input再填output
+    while (msg->input.size() < inputLen || msg->output.size() < outputLen)
+    {
+        int unused = -1;
+        n = recvMessage(&type, data.data(), data.size(), &unused);
+        if (n < 0 || type != kConnectionData)
+        {
+            LOG_ERROR("SocketHandoff::receive truncated connection data \n");
+            ::close(fd);
+            return false;
+        }
+        std::string &part = msg->input.size() < inputLen ? msg->input : msg->output;
+        part.append(data.data(), n);
+    }
+    return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <string>
+#include <stdint.h>
+
+/*
+零停机重启时新旧进程之间传递socket的通道
+基于SOCK_SEQPACKET类型的Unix域socket，保留消息边界，fd通过SCM_RIGHTS附带在消息上
+使用阻塞IO，只在重启交接期间短暂使用
+
+消息格式: type(1) | payload
+  kListenSocket  附带监听fd
+  kConnection    附带连接fd payload为inputLen(8) outputLen(8)，后面紧跟若干kConnectionData
+  kConnectionData 缓冲区数据分片，先input后output
+  kDone          交接结束
+*/
+class SocketHandoff : noncopyable
+{
+public:
+    enum MessageType : uint8_t
+    {
+        kListenSocket = 1,
+        kConnection = 2,
+        kConnectionData = 3,
+        kDone = 4,
+    };
+
+    // 收到的一条完整消息 连接的缓冲区分片已经拼接好
+    struct Message
+    {
+        Message() : type(0), fd(-1) {}
+
+        uint8_t type;
+        int fd;
+        std::string input;  // 连接inputBuffer中还没有处理的数据
+        std::string output; // 连接outputBuffer中还没有发送的数据
+    };
+
+    // 每个分片的最大长度 要小于Unix域socket的发送缓冲区
+    static const size_t kMaxChunk = 64 * 1024;
+
+    // 旧进程监听交接请求 返回非阻塞的监听fd，失败返回-1
+    static int listen(const std::string &path);
+    // 新进程连接旧进程 没有旧进程时返回-1
+    static int connect(const std::string &path);
+
+    // 接管一个已经连接的Unix域socket，析构时关闭
+    explicit SocketHandoff(int sockfd);
+    ~SocketHandoff();
+
+    bool sendListenSocket(int listenfd);
+    bool sendConnection(int connfd, const std::string &input, const std::string &output);
+    bool sendDone();
+
+    // 阻塞直到收到一条完整消息，连接断开或者出错返回false
+    bool receive(Message *msg);
+
+private:
+    bool sendMessage(uint8_t type, const void *data, size_t len, int fd);
+    // 返回payload长度，fd没有附带时为-1
+    ssize_t recvMessage(uint8_t *type, char *data, size_t len, int *fd);
+
+    const int sockfd_;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "copyable.h"
+
+#include <string>
+#include <string.h>
+#include <strings.h>
+
+// 不拥有内存的字符串视图 指向Buffer等外部存储，使用时要保证底层数据仍然有效
+class StringPiece : public copyable
+{
+public:
+    StringPiece() : ptr_(nullptr), length_(0) {}
+    StringPiece(const char *str) : ptr_(str), length_(strlen(str)) {}
+    StringPiece(const std::string &str) : ptr_(str.data()), length_(str.size()) {}
+    StringPiece(const char *offset, size_t len) : ptr_(offset), length_(len) {}
+
+    const char *data() const { return ptr_; }
+    size_t size() const { return length_; }
+    bool empty() const { return length_ == 0; }
+    const char *begin() const { return ptr_; }
+    const char *end() const { return ptr_ + length_; }
+    char operator[](size_t i) const { return ptr_[i]; }
+
+    void removePrefix(size_t n)
+    {
+        ptr_ += n;
+        length_ -= n;
+    }
+
+    bool operator==(const StringPiece &x) const
+    {
+        return length_ == x.length_ && memcmp(ptr_, x.ptr_, length_) == 0;
+    }
+    bool operator!=(const StringPiece &x) const { return !(*this == x); }
+
+    // 忽略大小写比较 用于HTTP头部名称等
+    bool equalsIgnoreCase(const StringPiece &x) const
+    {
+        return length_ == x.length_ && strncasecmp(ptr_, x.ptr_, length_) == 0;
+    }
+
+    bool startsWith(const StringPiece &x) const
+    {
+        return length_ >= x.length_ && memcmp(ptr_, x.ptr_, x.length_) == 0;
+    }
+
+    std::string asString() const { return std::string(ptr_, length_); }
+
+private:
+    const char *ptr_;
+    size_t length_;
+};
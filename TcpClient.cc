@@ -0,0 +1,124 @@
+#include "TcpClient.h"
+#include "Connector.h"
+#include "Logger.h"
+
+#include <functional>
+#include <strings.h>
+
+static EventLoop *CheckLoopNotNull(EventLoop *loop)
+{
+    if (loop == nullptr)
+    {
+        LOG_FATAL("%s:%s:%d TcpClient loop is null ! \n", __FILE__, __FUNCTION__, __LINE__);
+    }
+    return loop;
+}
+
+// TcpClient已经析构时，由它创建的连接关闭后在loop中销毁
+static void removeConnectionWithoutClient(EventLoop *loop, const TcpConnectionPtr &conn)
+{
+    loop->queueInLoop(std::bind(&TcpConnection::connectDestoryed, conn));
+}
+
+TcpClient::TcpClient(EventLoop *loop, const InetAddress &serverAddr, const std::string &nameArg)
+    : loop_(CheckLoopNotNull(loop)),
+      connector_(new Connector(loop, serverAddr)),
+      name_(nameArg),
+      retry_(false),
+      connect_(true),
+      nextConnId_(1)
+{
+    connector_->setNewConnectionCallback(std::bind(&TcpClient::newConnection, this, std::placeholders::_1));
+    LOG_INFO("TcpClient::TcpClient[%s] - connector %p \n", name_.c_str(), connector_.get());
+}
+
+TcpClient::~TcpClient()
+{
+    LOG_INFO("TcpClient::~TcpClient[%s] - connector %p \n", name_.c_str(), connector_.get());
+    TcpConnectionPtr conn;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        conn = connection_;
+    }
+    if (conn)
+    {
+        // 连接的关闭回调指向了即将析构的TcpClient，需要替换掉
+        CloseCallback cb = std::bind(&removeConnectionWithoutClient, loop_, std::placeholders::_1);
+        loop_->runInLoop([conn, cb]()
+                         { conn->setCloseCallback(cb); });
+        /*
+        连接在loop中由自己的锚点保持存活，其他地方持有的TcpConnectionPtr(连接池、排队的回调)只影响对象的生命周期，
+        不代表还有人负责关闭它，所以总是关闭 已经在关闭的连接forceClose什么也不做
+        */
+        conn->forceClose();
+    }
+    else
+    {
+        connector_->stop();
+    }
+}
+
+void TcpClient::connect()
+{
+    LOG_INFO("TcpClient::connect[%s] - connecting to %s \n", name_.c_str(),
+             connector_->serverAddress().toIpPort().c_str());
+    connect_ = true;
+    connector_->start();
+}
+
+void TcpClient::disconnect()
+{
+    connect_ = false;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (connection_)
+        {
+            connection_->shutdown();
+        }
+    }
+}
+
+void TcpClient::stop()
+{
+    connect_ = false;
+    connector_->stop();
+}
+
+void TcpClient::newConnection(int sockfd)
+{
+    InetAddress peerAddr = InetAddress::peerAddressOf(sockfd);
+    InetAddress localAddr = InetAddress::localAddressOf(sockfd);
+
+    char buf[128] = {0};
+    snprintf(buf, sizeof buf, ":%s#%d", peerAddr.toIpPort().c_str(), nextConnId_);
+    ++nextConnId_;
+    std::string connName = name_ + buf;
+
+    // 和TcpServer创建的连接完全一样，只是运行在TcpClient的loop上
+    TcpConnectionPtr conn(new TcpConnection(loop_, connName, sockfd, localAddr, peerAddr));
+    conn->setConnectionCallback(connectionCallback_);
+    conn->setMessageCallback(messageCallback_);
+    conn->setWriteCompleteCallbac(writeCompleteCallback_);
+    conn->setCloseCallback(std::bind(&TcpClient::removeConnection, this, std::placeholders::_1));
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        connection_ = conn;
+    }
+    conn->connectEstablished();
+}
+
+void TcpClient::removeConnection(const TcpConnectionPtr &conn)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        connection_.reset();
+    }
+
+    loop_->queueInLoop(std::bind(&TcpConnection::connectDestoryed, conn));
+    if (retry_ && connect_)
+    {
+        LOG_INFO("TcpClient::connect[%s] - Reconnecting to %s \n", name_.c_str(),
+                 connector_->serverAddress().toIpPort().c_str());
+        connector_->restart();
+    }
+}
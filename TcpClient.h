@@ -0,0 +1,67 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "EventLoop.h"
+#include "InetAddress.h"
+#include "Callbacks.h"
+#include "TcpConnection.h"
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+class Connector;
+using ConnectorPtr = std::shared_ptr<Connector>;
+
+/*
+TcpClient -> Connector 非阻塞connect成功 拿到sockfd
+-> TcpConnection 和服务端一样设置回调，运行在用户指定的loop上
+*/
+class TcpClient : noncopyable
+{
+public:
+    TcpClient(EventLoop *loop, const InetAddress &serverAddr, const std::string &nameArg);
+    ~TcpClient();
+
+    void connect();
+    void disconnect();
+    void stop();
+
+    TcpConnectionPtr connection()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return connection_;
+    }
+
+    EventLoop *getLoop() const { return loop_; }
+    bool retry() const { return retry_; }
+    // 连接建立后断开时自动重连
+    void enableRetry() { retry_ = true; }
+
+    const std::string &name() const { return name_; }
+
+    void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
+    void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
+    void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
+
+private:
+    // 在loop线程中执行 Connector连接成功后的回调
+    void newConnection(int sockfd);
+    // 在loop线程中执行 TcpConnection关闭时的回调
+    void removeConnection(const TcpConnectionPtr &conn);
+
+    EventLoop *loop_;
+    ConnectorPtr connector_;
+    const std::string name_;
+
+    ConnectionCallback connectionCallback_;
+    MessageCallback messageCallback_;
+    WriteCompleteCallback writeCompleteCallback_;
+
+    std::atomic_bool retry_;
+    std::atomic_bool connect_;
+    int nextConnId_;
+    std::mutex mutex_;
+    TcpConnectionPtr connection_; // 由mutex_保护
+};
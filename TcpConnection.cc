@@ -3,12 +3,20 @@
 #include "Socket.h"
 #include "Channel.h"
 #include "EventLoop.h"
+#include "BufferArena.h"
 
 #include <functional>
 #include <sys/socket.h>
+#include <fcntl.h>
 #include <memory>
 #include <errno.h>
 #include <string>
+#include <algorithm>
+
+// 限速时每次至少攒够这么多令牌再发送/读取，避免大量小块读写
+static const size_t kShapingChunk = 4096;
+// 限速定时器的最短间隔(秒)
+static const double kMinShapingDelay = 0.001;
 
 static EventLoop *CheckLoopNotNull(EventLoop *loop)
 {
@@ -25,6 +33,7 @@ TcpConnection::TcpConnection(EventLoop *loop,
                              const InetAddress &localAddr,
                              const InetAddress &peerAddr)
     : loop_(CheckLoopNotNull(loop)),
+      migration_(kSettled),
       name_(nameArg),
       state_(kConnecting),
       reading_(true),
@@ -32,16 +41,87 @@ TcpConnection::TcpConnection(EventLoop *loop,
       channel_(new Channel(loop, sockfd)),
       localAddr_(localAddr),
       peerAddr_(peerAddr),
-      highWaterMark_(64 * 1024 * 1024) // 64M
+      highWaterMark_(64 * 1024 * 1024), // 64M
+      recvLowat_(1),
+      readThrottles_(0),
+      backpressureHigh_(0),
+      backpressureLow_(0),
+      backpressured_(false),
+      maxOutputBytes_(0),
+      stallTimeout_(0),
+      stallTimerActive_(false),
+      writeResumeScheduled_(false),
+      readResumeScheduled_(false),
+      corked_(false),
+      flushQueued_(false),
+      quickAck_(false),
+      busyNanoSeconds_(0),
+      bufferBytes_(0),
+      memoryThrottled_(false),
+      inputBuffer_(0, loop->bufferArena()), // 第一次读写时再分配
+      outputBuffer_(0, loop->bufferArena())
+{
+    setupChannel();
+    updateBufferBytes();
+
+    LOG_INFO("TcpConnection::ctor[%s] at fd=%d\n", name_.c_str(), sockfd);
+    socket_->setKeepalive(true);
+}
+
+// 给Channel设置相应的回调函数，poller给channel通知感兴趣的事件发生，channel会回调相应的操作函数
+void TcpConnection::setupChannel()
 {
-    // 给Channel设置相应的回调函数，poller给channel通知感兴趣的事件发生，channel会回调相应的操作函数
     channel_->setReadCallback(std::bind(&TcpConnection::handleRead, this, std::placeholders::_1));
     channel_->setWriteCallback(std::bind(&TcpConnection::handleWrite, this));
     channel_->setCloseCallback(std::bind(&TcpConnection::handleClose, this));
     channel_->setErrorCallback(std::bind(&TcpConnection::handleError, this));
+}
 
-    LOG_INFO("TcpConnection::ctor[%s] at fd=%d\n", name_.c_str(), sockfd);
-    socket_->setKeepalive(true);
+bool TcpConnection::needsForward() const
+{
+    return migration_.load(std::memory_order_acquire) == kMoving || !loop()->isInLoopThread();
+}
+
+void TcpConnection::runInOwnerLoop(std::function<void()> cb)
+{
+    if (migration_.load(std::memory_order_acquire) == kSettled && loop()->isInLoopThread())
+    {
+        cb();
+    }
+    else
+    {
+        queueInOwnerLoop(std::move(cb));
+    }
+}
+
+void TcpConnection::queueInOwnerLoop(std::function<void()> cb)
+{
+    // 读migration_和loop_、入队在同一把锁下完成，迁移开始后的调用不会插到迁移前的调用前面
+    std::lock_guard<std::mutex> lock(pendingMutex_);
+    if (migration_.load(std::memory_order_acquire) != kSettled)
+    {
+        pendingCalls_.push_back(std::move(cb));
+    }
+    else
+    {
+        loop()->queueInLoop(std::move(cb));
+    }
+}
+
+// 迁移结束(或取消)后在所属loop中调用 按顺序执行迁移期间暂存的调用
+void TcpConnection::runPendingCalls()
+{
+    std::vector<std::function<void()>> calls;
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex_);
+        calls.swap(pendingCalls_);
+        migration_.store(kSettled, std::memory_order_release);
+    }
+    // 之后的调用直接进入loop的队列，排在这些调用之后执行
+    for (const std::function<void()> &call : calls)
+    {
+        call();
+    }
 }
 
 TcpConnection::~TcpConnection()
@@ -50,20 +130,54 @@ TcpConnection::~TcpConnection()
 }
 
 void TcpConnection::send(const std::string &buf)
+{
+    send(buf.data(), buf.size());
+}
+
+void TcpConnection::send(const void *data, size_t len)
+{
+    if (state_ == kConnected)
+    {
+        if (migration_.load(std::memory_order_acquire) == kSettled && loop()->isInLoopThread())
+        {
+            sendInLoop(data, len);
+        }
+        else
+        {
+            // 跨线程时调用方的数据可能在回调执行前失效，需要拷贝一份
+            queueInOwnerLoop(std::bind(&TcpConnection::sendStringInLoop, shared_from_this(),
+                                       std::string(static_cast<const char *>(data), len)));
+        }
+    }
+}
+
+void TcpConnection::send(Buffer *buf)
 {
     if (state_ == kConnected)
     {
-        if (loop_->isInLoopThread())
+        if (migration_.load(std::memory_order_acquire) == kSettled && loop()->isInLoopThread())
         {
-            sendInLoop(buf.c_str(), buf.size());
+            sendInLoop(buf->peek(), buf->readableBytes());
+            buf->retrieveAll();
         }
         else
         {
-            loop_->runInLoop(std::bind(&TcpConnection::sendInLoop, this, buf.c_str(), buf.size()));
+            queueInOwnerLoop(std::bind(&TcpConnection::sendStringInLoop, shared_from_this(),
+                                       buf->retriveAllAsString()));
         }
     }
 }
 
+void TcpConnection::sendStringInLoop(const std::string &message)
+{
+    if (needsForward())
+    {
+        queueInOwnerLoop(std::bind(&TcpConnection::sendStringInLoop, shared_from_this(), message));
+        return;
+    }
+    sendInLoop(message.data(), message.size());
+}
+
 /*
 发送数据 应用写的快 而内核发送数据慢 需要把待发送数据写入缓冲区 而且设置了水位回调
 */
@@ -79,20 +193,28 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
         return;
     }
 
-    // 表示channel第一次开始写数据而且缓冲区没有待发送数据
-    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+    bool throttled = false;
+    // 表示channel第一次开始写数据而且缓冲区没有待发送数据 cork模式下只写缓冲区，在本轮循环结束时统一发送
+    if (!corked_ && !channel_->isWriting() && !writeResumeScheduled_ && outputBuffer_.readableBytes() == 0)
     {
-        nwrote = ::write(channel_->fd(), data, len);
+        size_t quota = egressQuota(len);
+        throttled = quota < len;
+        if (quota > 0)
+        {
+            nwrote = ::write(channel_->fd(), data, quota);
+        }
         if (nwrote >= 0)
         {
+            refundEgress(quota - nwrote);
             remaining = len - nwrote;
             if (remaining == 0 && writeCompleteCallback_)
             {
-                loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+                queueWriteComplete();
             }
         }
         else
         {
+            refundEgress(quota);
             nwrote = 0;
             if (errno != EWOULDBLOCK)
             {
@@ -115,13 +237,27 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
         size_t oldLen = outputBuffer_.readableBytes();
         if (oldLen + remaining >= highWaterMark_ && oldLen < highWaterMark_ && highWaterMarkCallback_)
         {
-            loop_->queueInLoop(std::bind(highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
+            loop()->queueInLoop(std::bind(highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
         }
         outputBuffer_.append((char *)data + nwrote, remaining);
-        if (!channel_->isWriting())
+        if (corked_)
+        {
+            if (!flushQueued_ && !channel_->isWriting() && !writeResumeScheduled_)
+            {
+                flushQueued_ = true;
+                loop()->queueFlush(handle());
+            }
+        }
+        else if (throttled)
+        {
+            scheduleWriteResume(); // 令牌不足，等令牌补齐后再注册写事件
+        }
+        else if (!channel_->isWriting() && !writeResumeScheduled_)
         {
             channel_->enableWriting(); // 这里一定要注册channel的写事件，否则poller不会给channel通知epollout
         }
+        checkBackpressure();
+        updateBufferBytes();
     }
 }
 
@@ -130,47 +266,496 @@ void TcpConnection::shutdown()
     if (state_ == kConnected)
     {
         setState(kDisconnecting);
-        loop_->runInLoop(std::bind(&TcpConnection::shutdownInLoop, this));
+        runInOwnerLoop(std::bind(&TcpConnection::shutdownInLoop, this));
     }
 }
 
 void TcpConnection::shutdownInLoop()
 {
-    if (!channel_->isWriting()) // 说明当前outputbuffer中的数据已经全部发送完成
+    if (needsForward())
+    {
+        queueInOwnerLoop(std::bind(&TcpConnection::shutdownInLoop, this));
+        return;
+    }
+    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0) // 说明当前outputbuffer中的数据已经全部发送完成
     {
         socket_->shutdownWrite(); // 关闭写端
     }
 }
 
+void TcpConnection::forceClose()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        setState(kDisconnecting);
+        queueInOwnerLoop(std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::forceCloseInLoop()
+{
+    if (needsForward())
+    {
+        queueInOwnerLoop(std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+        return;
+    }
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        handleClose(); // 和对端关闭一样处理
+    }
+}
+
+void TcpConnection::setTcpNoDelay(bool on)
+{
+    socket_->setTcpNoDelay(on);
+}
+
+void TcpConnection::setQuickAck(bool on)
+{
+    quickAck_ = on;
+    socket_->setQuickAck(on);
+}
+
+void TcpConnection::setRecvLowat(int bytes)
+{
+    if (bytes < 1)
+    {
+        bytes = 1;
+    }
+    if (bytes != recvLowat_)
+    {
+        recvLowat_ = bytes;
+        socket_->setRecvLowat(bytes);
+    }
+}
+
+void TcpConnection::startRead()
+{
+    runInOwnerLoop(std::bind(&TcpConnection::startReadInLoop, shared_from_this()));
+}
+
+void TcpConnection::stopRead()
+{
+    runInOwnerLoop(std::bind(&TcpConnection::stopReadInLoop, shared_from_this()));
+}
+
+void TcpConnection::startReadInLoop()
+{
+    if (needsForward())
+    {
+        queueInOwnerLoop(std::bind(&TcpConnection::startReadInLoop, shared_from_this()));
+        return;
+    }
+    reading_ = true;
+    updateReading();
+}
+
+void TcpConnection::stopReadInLoop()
+{
+    if (needsForward())
+    {
+        queueInOwnerLoop(std::bind(&TcpConnection::stopReadInLoop, shared_from_this()));
+        return;
+    }
+    reading_ = false;
+    updateReading();
+}
+
+void TcpConnection::throttleReadInLoop(bool on)
+{
+    if (needsForward())
+    {
+        queueInOwnerLoop(std::bind(&TcpConnection::throttleReadInLoop, shared_from_this(), on));
+        return;
+    }
+    readThrottles_ += on ? 1 : -1;
+    updateReading();
+}
+
+void TcpConnection::updateReading()
+{
+    if (state_ != kConnected && state_ != kDisconnecting)
+    {
+        return;
+    }
+    if (isReading() && !channel_->isReading())
+    {
+        channel_->enableReading();
+    }
+    else if (!isReading() && channel_->isReading())
+    {
+        channel_->disableReading();
+    }
+}
+
+void TcpConnection::enableBackpressure(size_t highMark, size_t lowMark)
+{
+    backpressureHigh_ = highMark;
+    backpressureLow_ = lowMark < highMark ? lowMark : highMark / 2;
+    checkBackpressure();
+}
+
+void TcpConnection::setBackpressureSource(const TcpConnectionPtr &source)
+{
+    backpressureSource_ = source;
+}
+
+void TcpConnection::setSlowConsumerPolicy(size_t maxOutputBytes, double stallTimeout)
+{
+    maxOutputBytes_ = maxOutputBytes;
+    stallTimeout_ = stallTimeout;
+    checkBackpressure();
+}
+
+// 输出缓冲区增长后检查 在sendInLoop中调用
+void TcpConnection::checkBackpressure()
+{
+    size_t pending = outputBuffer_.readableBytes();
+    if (maxOutputBytes_ > 0 && pending > maxOutputBytes_)
+    {
+        LOG_ERROR("TcpConnection %s slow consumer, %lu bytes pending, evicted \n", name_.c_str(), pending);
+        forceClose();
+        return;
+    }
+    if (backpressureHigh_ == 0 || backpressured_ || pending < backpressureHigh_)
+    {
+        return;
+    }
+
+    TcpConnectionPtr target = backpressureSource_.lock();
+    if (!target)
+    {
+        // 没有指定上游或者上游已经关闭，暂停本连接
+        target = shared_from_this();
+    }
+    backpressured_ = true;
+    throttledConn_ = target;
+    target->runInOwnerLoop(std::bind(&TcpConnection::throttleReadInLoop, target, true));
+
+    startStallTimer();
+}
+
+void TcpConnection::startStallTimer()
+{
+    if (stallTimeout_ <= 0)
+    {
+        return;
+    }
+    std::weak_ptr<TcpConnection> weakSelf(shared_from_this());
+    stallTimer_ = loop()->runAfter(stallTimeout_, [weakSelf]()
+                                   {
+                                       TcpConnectionPtr self = weakSelf.lock();
+                                       if (self)
+                                       {
+                                           self->handleStall();
+                                       } });
+    stallTimerActive_ = true;
+}
+
+// 输出缓冲区降到lowMark以下或者连接关闭时调用
+void TcpConnection::releaseBackpressure()
+{
+    if (!backpressured_)
+    {
+        return;
+    }
+    backpressured_ = false;
+    TcpConnectionPtr target = throttledConn_.lock();
+    throttledConn_.reset();
+    if (target)
+    {
+        target->runInOwnerLoop(std::bind(&TcpConnection::throttleReadInLoop, target, false));
+    }
+    if (stallTimerActive_)
+    {
+        loop()->cancel(stallTimer_);
+        stallTimerActive_ = false;
+    }
+}
+
+void TcpConnection::handleStall()
+{
+    stallTimerActive_ = false;
+    if (backpressured_ && state_ == kConnected)
+    {
+        LOG_ERROR("TcpConnection %s slow consumer, stalled %.1fs with %lu bytes pending, evicted \n",
+                  name_.c_str(), stallTimeout_, outputBuffer_.readableBytes());
+        forceClose();
+    }
+}
+
+void TcpConnection::setEgressLimit(double bytesPerSecond, double burstBytes)
+{
+    egressLimit_.reset(bytesPerSecond > 0 ? new TokenBucket(bytesPerSecond, burstBytes) : nullptr);
+}
+
+void TcpConnection::setIngressLimit(double bytesPerSecond, double burstBytes)
+{
+    ingressLimit_.reset(bytesPerSecond > 0 ? new TokenBucket(bytesPerSecond, burstBytes) : nullptr);
+}
+
+size_t TcpConnection::egressQuota(size_t want)
+{
+    if (!egressLimit_ && !sharedEgress_)
+    {
+        return want;
+    }
+    Timestamp now(loop()->now());
+    size_t quota = want;
+    if (egressLimit_)
+    {
+        quota = egressLimit_->consume(quota, now);
+    }
+    if (sharedEgress_ && quota > 0)
+    {
+        size_t shared = sharedEgress_->consume(quota, now);
+        if (egressLimit_ && shared < quota)
+        {
+            egressLimit_->refund(quota - shared);
+        }
+        quota = shared;
+    }
+    return quota;
+}
+
+void TcpConnection::refundEgress(size_t n)
+{
+    if (n == 0)
+    {
+        return;
+    }
+    if (egressLimit_)
+    {
+        egressLimit_->refund(n);
+    }
+    if (sharedEgress_)
+    {
+        sharedEgress_->refund(n);
+    }
+}
+
+void TcpConnection::scheduleWriteResume()
+{
+    if (writeResumeScheduled_)
+    {
+        return;
+    }
+    Timestamp now(loop()->now());
+    size_t need = std::min(outputBuffer_.readableBytes(), kShapingChunk);
+    double delay = kMinShapingDelay;
+    if (egressLimit_)
+    {
+        delay = std::max(delay, egressLimit_->delay(need, now));
+    }
+    if (sharedEgress_)
+    {
+        delay = std::max(delay, sharedEgress_->delay(need, now));
+    }
+
+    std::weak_ptr<TcpConnection> weakSelf(shared_from_this());
+    writeResumeTimer_ = loop()->runAfter(delay, [weakSelf]()
+                                        {
+                                            TcpConnectionPtr self = weakSelf.lock();
+                                            if (self)
+                                            {
+                                                self->resumeWriting();
+                                            } });
+    writeResumeScheduled_ = true;
+}
+
+void TcpConnection::resumeWriting()
+{
+    writeResumeScheduled_ = false;
+    if ((state_ == kConnected || state_ == kDisconnecting) &&
+        outputBuffer_.readableBytes() > 0 && !channel_->isWriting())
+    {
+        channel_->enableWriting();
+    }
+}
+
+// 读到数据之后再扣令牌，透支时暂停读取，等令牌补齐
+void TcpConnection::chargeIngress(size_t n)
+{
+    if (!ingressLimit_ && !sharedIngress_)
+    {
+        return;
+    }
+    Timestamp now(loop()->now());
+    double delay = 0;
+    if (ingressLimit_)
+    {
+        ingressLimit_->charge(n, now);
+        delay = std::max(delay, ingressLimit_->delay(kShapingChunk, now));
+    }
+    if (sharedIngress_)
+    {
+        sharedIngress_->charge(n, now);
+        delay = std::max(delay, sharedIngress_->delay(kShapingChunk, now));
+    }
+    if (delay <= 0 || readResumeScheduled_)
+    {
+        return;
+    }
+
+    throttleReadInLoop(true);
+    std::weak_ptr<TcpConnection> weakSelf(shared_from_this());
+    readResumeTimer_ = loop()->runAfter(std::max(delay, kMinShapingDelay), [weakSelf]()
+                                       {
+                                           TcpConnectionPtr self = weakSelf.lock();
+                                           if (self)
+                                           {
+                                               self->resumeReading();
+                                           } });
+    readResumeScheduled_ = true;
+}
+
+void TcpConnection::resumeReading()
+{
+    readResumeScheduled_ = false;
+    throttleReadInLoop(false);
+}
+
+void TcpConnection::cancelShapingTimers()
+{
+    if (writeResumeScheduled_)
+    {
+        loop()->cancel(writeResumeTimer_);
+        writeResumeScheduled_ = false;
+    }
+    if (readResumeScheduled_)
+    {
+        loop()->cancel(readResumeTimer_);
+        readResumeScheduled_ = false;
+        --readThrottles_;
+    }
+}
+
+void TcpConnection::handoff(const HandoffCallback &cb)
+{
+    runInOwnerLoop(std::bind(&TcpConnection::handoffInLoop, shared_from_this(), cb));
+}
+
+void TcpConnection::handoffInLoop(const HandoffCallback &cb)
+{
+    if (needsForward())
+    {
+        queueInOwnerLoop(std::bind(&TcpConnection::handoffInLoop, shared_from_this(), cb));
+        return;
+    }
+    if (state_ != kConnected)
+    {
+        cb(-1, std::string(), std::string());
+        return;
+    }
+
+    int fd = ::fcntl(channel_->fd(), F_DUPFD_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        LOG_ERROR("TcpConnection::handoff %s dup err:%d \n", name_.c_str(), errno);
+        cb(-1, std::string(), std::string());
+        return;
+    }
+    std::string input = inputBuffer_.retriveAllAsString();
+    std::string output = outputBuffer_.retriveAllAsString();
+    handleClose(); // 本进程中的连接对象销毁，socket由fd副本继续持有
+    cb(fd, input, output);
+}
+
+void TcpConnection::restoreBuffers(const std::string &input, const std::string &output)
+{
+    inputBuffer_.append(input.data(), input.size());
+    outputBuffer_.append(output.data(), output.size());
+}
+
 void TcpConnection::connectEstablished()
 {
     setState(kConnected);
-    channel_->tie(shared_from_this());
+    anchorInLoop();
     channel_->enableReading(); // 向poller注册channel的epollin事件
 
     // 新连接建立，执行回调
-    connectionCallback_(shared_from_this());
+    connectionCallback_(anchorRef_.ptr());
+
+    // 从旧进程接管的连接 继续发送和处理交接时留在缓冲区中的数据
+    if (outputBuffer_.readableBytes() > 0 && !channel_->isWriting())
+    {
+        channel_->enableWriting();
+    }
+    if (inputBuffer_.readableBytes() > 0 && state_ == kConnected)
+    {
+        messageCallback_(anchorRef_.ptr(), &inputBuffer_, loop()->now());
+    }
 }
 
 void TcpConnection::connectDestoryed()
 {
+    if (needsForward())
+    {
+        queueInOwnerLoop(std::bind(&TcpConnection::connectDestoryed, shared_from_this()));
+        return;
+    }
     if (state_ == kConnected)
     {
         setState(kDisconnected);
         channel_->disableAll(); // 把channel的所有感兴趣的事件从poller中删除
+        releaseBackpressure();
+        cancelShapingTimers();
         connectionCallback_(shared_from_this());
     }
     channel_->remove(); // 把channel从poller中删除
+    unanchorInLoop();
+}
+
+TcpConnectionHandle TcpConnection::handle()
+{
+    if (anchorRef_)
+    {
+        return anchorRef_;
+    }
+    return TcpConnectionHandle(new ConnectionAnchor(shared_from_this()));
+}
+
+void TcpConnection::anchorInLoop()
+{
+    anchorRef_ = TcpConnectionHandle(new ConnectionAnchor(shared_from_this()));
+    loop()->addAnchor(&anchorRef_);
+}
+
+void TcpConnection::unanchorInLoop()
+{
+    if (!anchorRef_)
+    {
+        return;
+    }
+    loop()->removeAnchor(&anchorRef_);
+    // 推迟到本轮循环的事件回调之后释放 当前调用栈中的连接和Channel仍然有效
+    TcpConnectionHandle last(std::move(anchorRef_));
+    loop()->queueInLoop([last]() {});
+}
+
+// 本loop内排队的回调持有句柄 不修改原子计数
+void TcpConnection::queueWriteComplete()
+{
+    TcpConnectionHandle self(handle());
+    loop()->queueInLoop([self]()
+                        { self->writeCompleteCallback_(self.ptr()); });
 }
 
 void TcpConnection::handleRead(Timestamp receiveTime)
 {
+    int64_t start = Timestamp::monotonicNanoSeconds();
     int savedErrno = 0;
     ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
     if (n > 0)
     {
+        chargeIngress(n);
+        if (quickAck_)
+        {
+            socket_->setQuickAck(true);
+        }
         // 已建立连接的用户，有可读事件发生， 调用用户传入的回调操作onMessage
-        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        messageCallback_(anchorRef_.ptr(), &inputBuffer_, receiveTime);
+        releaseIdleBuffer(&inputBuffer_);
     }
     else if (n == 0)
     {
@@ -182,41 +767,289 @@ void TcpConnection::handleRead(Timestamp receiveTime)
         LOG_ERROR("TcpConnection::handleRead error!");
         handleError();
     }
+    updateBufferBytes();
+    addBusyTime(start); // 锚点在本轮循环结束后才释放，handleClose之后对象仍然有效
 }
 
 void TcpConnection::handleWrite()
 {
     if (channel_->isWriting())
     {
-        int savedErrno = 0;
-        ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno); // 与源码不同，将写的细节封装在了Buffer中
+        int64_t start = Timestamp::monotonicNanoSeconds();
+        writeOutputBuffer();
+        addBusyTime(start);
+    }
+    else
+    {
+        LOG_ERROR("Connection fd = %d is down, no more writing \n", channel_->fd());
+    }
+}
 
-        if (n > 0)
+// 把outputBuffer_中的数据写到socket 在EPOLLOUT和cork刷新时调用
+void TcpConnection::writeOutputBuffer()
+{
+    size_t pending = outputBuffer_.readableBytes();
+    size_t quota = egressQuota(pending);
+    if (quota == 0)
+    {
+        // 令牌用完了，关闭写事件，等令牌补齐
+        if (channel_->isWriting())
+        {
+            channel_->disableWriting();
+        }
+        scheduleWriteResume();
+        return;
+    }
+
+    int savedErrno = 0;
+    ssize_t n = outputBuffer_.writeFd(channel_->fd(), quota, &savedErrno); // 与源码不同，将写的细节封装在了Buffer中
+    refundEgress(n > 0 ? quota - n : quota);
+
+    if (n > 0)
+    {
+        outputBuffer_.retrieve(n);
+        if (backpressured_ && outputBuffer_.readableBytes() <= backpressureLow_)
+        {
+            releaseBackpressure();
+        }
+        if (outputBuffer_.readableBytes() == 0)
         {
-            outputBuffer_.retrieve(n);
-            if (outputBuffer_.readableBytes() == 0)
+            if (channel_->isWriting())
             {
                 channel_->disableWriting();
-                if (writeCompleteCallback_)
-                {
-                    // 唤醒loop_对应的thread线程，执行回调
-                    loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
-                }
-                if (state_ == kDisconnecting)
-                {
-                    shutdownInLoop();
-                }
+            }
+            releaseIdleBuffer(&outputBuffer_);
+            updateBufferBytes();
+            if (writeCompleteCallback_)
+            {
+                // 唤醒loop_对应的thread线程，执行回调
+                queueWriteComplete();
+            }
+            if (state_ == kDisconnecting)
+            {
+                shutdownInLoop();
             }
         }
-        else
+        else if (quota < pending)
+        {
+            if (channel_->isWriting())
+            {
+                channel_->disableWriting();
+            }
+            scheduleWriteResume();
+        }
+        else if (!channel_->isWriting())
         {
-            LOG_ERROR("TcpConnection::handleWrite error !");
+            channel_->enableWriting(); // 内核发送缓冲区满了，剩余的等EPOLLOUT
+        }
+    }
+    else if (savedErrno == EWOULDBLOCK)
+    {
+        if (!channel_->isWriting())
+        {
+            channel_->enableWriting();
         }
     }
     else
     {
-        LOG_ERROR("Connection fd = %d is down, no more writing \n", channel_->fd());
+        LOG_ERROR("TcpConnection::handleWrite error !");
+    }
+}
+
+void TcpConnection::setCorked(bool on)
+{
+    corked_ = on;
+}
+
+void TcpConnection::flushCorked()
+{
+    if (needsForward())
+    {
+        // 迁移前登记在旧loop中的刷新 迁移时已经处理过
+        return;
+    }
+    flushQueued_ = false;
+    if ((state_ == kConnected || state_ == kDisconnecting) && outputBuffer_.readableBytes() > 0 &&
+        !channel_->isWriting() && !writeResumeScheduled_)
+    {
+        writeOutputBuffer();
+    }
+}
+
+void TcpConnection::setMemoryThrottled(bool on)
+{
+    runInOwnerLoop(std::bind(&TcpConnection::setMemoryThrottledInLoop, shared_from_this(), on));
+}
+
+void TcpConnection::setMemoryThrottledInLoop(bool on)
+{
+    if (needsForward())
+    {
+        queueInOwnerLoop(std::bind(&TcpConnection::setMemoryThrottledInLoop, shared_from_this(), on));
+        return;
+    }
+    if (memoryThrottled_ != on)
+    {
+        memoryThrottled_ = on;
+        throttleReadInLoop(on);
+    }
+}
+
+void TcpConnection::shrinkBuffers()
+{
+    runInOwnerLoop(std::bind(&TcpConnection::shrinkBuffersInLoop, shared_from_this()));
+}
+
+void TcpConnection::shrinkBuffersInLoop()
+{
+    if (needsForward())
+    {
+        queueInOwnerLoop(std::bind(&TcpConnection::shrinkBuffersInLoop, shared_from_this()));
+        return;
+    }
+    // 内存压力下环形缓冲区也释放
+    if (inputBuffer_.release())
+    {
+        BufferAccountant::instance().recordShrunk();
+    }
+    if (outputBuffer_.release())
+    {
+        BufferAccountant::instance().recordShrunk();
+    }
+    updateBufferBytes();
+}
+
+// 读完/发完的缓冲区把内存还给所在loop的BufferArena，空闲连接不占用缓冲区内存
+// 环形缓冲区每次分配都要重新映射，不在这里释放
+void TcpConnection::releaseIdleBuffer(Buffer *buf)
+{
+    if (!buf->mirrored())
+    {
+        buf->release();
+    }
+}
+
+void TcpConnection::setMirroredBuffers(bool on)
+{
+    BufferAllocator *allocator = on ? BufferAllocator::mirrored() : loop()->bufferArena();
+    inputBuffer_.rebind(allocator);
+    outputBuffer_.rebind(allocator);
+    updateBufferBytes();
+}
+
+void TcpConnection::migrateTo(EventLoop *target)
+{
+    // 总是排队执行 不能在handleEvent的过程中销毁Channel
+    queueInOwnerLoop(std::bind(&TcpConnection::migrateInLoop, shared_from_this(), target));
+}
+
+void TcpConnection::migrateInLoop(EventLoop *target)
+{
+    if (needsForward() || migration_.load(std::memory_order_acquire) != kSettled)
+    {
+        // 上一次迁移还没完成时 排在它之后执行
+        queueInOwnerLoop(std::bind(&TcpConnection::migrateInLoop, shared_from_this(), target));
+        return;
+    }
+    EventLoop *current = loop();
+    if (target == nullptr || target == current || state_ != kConnected)
+    {
+        return;
+    }
+
+    /*
+    先进入kDraining：之后的调用都暂存到pendingCalls_，而迁移前已经排在旧loop队列中的调用
+    都排在finishMigrateInLoop前面，仍然在旧loop上执行，这样迁移前后的调用不会乱序
+    */
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex_);
+        migration_.store(kDraining, std::memory_order_release);
+    }
+    current->queueInLoop(std::bind(&TcpConnection::finishMigrateInLoop, shared_from_this(), target));
+}
+
+void TcpConnection::finishMigrateInLoop(EventLoop *target)
+{
+    EventLoop *current = loop();
+    if (state_ != kConnected)
+    {
+        // 排空期间连接关闭了 取消迁移
+        runPendingCalls();
+        return;
+    }
+    LOG_INFO("TcpConnection %s migrate from loop %p to loop %p \n", name_.c_str(), current, target);
+
+    // cork中还没写出的数据先在旧loop中写出，保证字节顺序
+    if (flushQueued_)
+    {
+        flushCorked();
+    }
+
+    bool writing = channel_->isWriting();
+    channel_->disableAll();
+    channel_->remove();
+
+    // 定时器属于旧loop的TimerQueue 取消后在新loop中重新设置
+    if (writeResumeScheduled_)
+    {
+        current->cancel(writeResumeTimer_);
+        writeResumeScheduled_ = false;
+    }
+    bool resumeRead = readResumeScheduled_;
+    if (resumeRead)
+    {
+        current->cancel(readResumeTimer_); // 限速占用的readThrottles_留给新loop的resumeReading释放
+    }
+    bool restartStall = stallTimerActive_;
+    if (restartStall)
+    {
+        current->cancel(stallTimer_);
+        stallTimerActive_ = false;
+    }
+
+    unanchorInLoop(); // 旧锚点在旧loop上释放 新loop在attachInLoop中创建自己的锚点
+    channel_.reset(new Channel(target, socket_->fd()));
+    setupChannel();
+    migration_.store(kMoving, std::memory_order_release);
+    loop_.store(target, std::memory_order_release);
+    target->queueInLoop(std::bind(&TcpConnection::attachInLoop, shared_from_this(), writing, resumeRead, restartStall));
+}
+
+void TcpConnection::attachInLoop(bool writing, bool resumeRead, bool restartStall)
+{
+    anchorInLoop();
+    // 缓冲区换到新loop的内存池 之后的扩容和释放都不需要跨线程加锁 环形缓冲区不属于任何loop，不用换
+    if (!inputBuffer_.mirrored())
+    {
+        inputBuffer_.rebind(loop()->bufferArena());
+    }
+    if (!outputBuffer_.mirrored())
+    {
+        outputBuffer_.rebind(loop()->bufferArena());
+    }
+    updateBufferBytes();
+    // 迁移期间可能被shutdown或forceClose 仍然要注册，把剩下的数据写完或者执行关闭
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        if (isReading())
+        {
+            channel_->enableReading();
+        }
+        if (writing || (outputBuffer_.readableBytes() > 0 && (egressLimit_ || sharedEgress_)))
+        {
+            // 原来在等EPOLLOUT的继续等，原来在等令牌的直接注册，令牌不足时writeOutputBuffer会重新推迟
+            channel_->enableWriting();
+        }
+        if (resumeRead)
+        {
+            resumeReading();
+        }
+        if (restartStall && backpressured_)
+        {
+            startStallTimer();
+        }
     }
+    runPendingCalls();
 }
 
 void TcpConnection::handleClose()
@@ -224,6 +1057,8 @@ void TcpConnection::handleClose()
     LOG_INFO("fd=%d state=%d \n", channel_->fd(), (int)state_);
     setState(kDisconnected);
     channel_->disableAll();
+    releaseBackpressure(); // 连接关闭时恢复上游连接的读取
+    cancelShapingTimers();
 
     TcpConnectionPtr connPtr(shared_from_this());
     connectionCallback_(connPtr); // 执行连接关闭的回调
@@ -4,11 +4,17 @@
 #include "InetAddress.h"
 #include "Callbacks.h"
 #include "Buffer.h"
+#include "TcpConnectionHandle.h"
 #include "Timestamp.h"
+#include "TimerId.h"
+#include "TokenBucket.h"
 
 #include <memory>
 #include <string>
 #include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
 
 class Channel;
 class EventLoop;
@@ -29,17 +35,27 @@ public:
 
     ~TcpConnection();
 
-    EventLoop *getLoop() const { return loop_; }
+    // 连接迁移后会变成新的loop 可以在任意线程调用
+    EventLoop *getLoop() const { return loop_.load(std::memory_order_acquire); }
     const std::string &name() const { return name_; }
     const InetAddress &localAddress() const { return localAddr_; }
     const InetAddress &peerAddress() const { return peerAddr_; }
 
     bool connected() const { return state_ == kConnected; }
 
+    // 上层协议(如HttpServer)保存在连接上的状态 只在loop线程中访问
+    void setContext(const std::shared_ptr<void> &context) { context_ = context; }
+    const std::shared_ptr<void> &getContext() const { return context_; }
+
     // 发送数据
     void send(const std::string &buf);
+    void send(const void *data, size_t len);
+    // 发送Buffer中全部可读数据并清空buf
+    void send(Buffer *buf);
     // 关闭连接
     void shutdown();
+    // 不等待输出缓冲区发送完成，直接关闭连接
+    void forceClose();
 
     void setConnectionCallback(const ConnectionCallback &cb)
     {
@@ -67,6 +83,103 @@ public:
         closeCallback_ = cb;
     }
 
+    void setTcpNoDelay(bool on);
+    // TCP_QUICKACK不是持久的，内核发出一个ACK后会回到延迟确认，开启后每次读完数据重新设置
+    void setQuickAck(bool on);
+
+    // 设置SO_RCVLOWAT 只能在loop线程中调用，和当前值相同时不做系统调用
+    void setRecvLowat(int bytes);
+
+    // 暂停/恢复读取 可以在任意线程调用
+    void startRead();
+    void stopRead();
+    // 只能在loop线程中调用 用户没有stopRead且没有被反压暂停时为true
+    bool isReading() const { return reading_ && readThrottles_ == 0; }
+    // 计数式暂停读取 和反压、限速共用计数，on/off必须成对调用 只能在loop线程中调用
+    void throttleRead(bool on) { throttleReadInLoop(on); }
+
+    /*
+    自动反压 输出缓冲区超过highMark时暂停读取，发送到lowMark以下后恢复
+    默认暂停本连接的读取，代理场景下用setBackpressureSource指定向本连接写数据的上游连接
+    只能在loop线程中调用
+    */
+    void enableBackpressure(size_t highMark, size_t lowMark);
+    void setBackpressureSource(const TcpConnectionPtr &source);
+    bool backpressured() const { return backpressured_; }
+
+    /*
+    慢消费者驱逐 输出缓冲区超过maxOutputBytes时立即断开；
+    反压持续stallTimeout秒仍没有降到lowMark以下时断开，小于等于0表示不限制
+    只能在loop线程中调用
+    */
+    void setSlowConsumerPolicy(size_t maxOutputBytes, double stallTimeout);
+
+    /*
+    令牌桶限速 bytesPerSecond小于等于0表示取消限速 只能在loop线程中调用
+    发送令牌不足时数据留在outputBuffer_中，用定时器推迟到令牌补齐后再开启EPOLLOUT；
+    接收令牌透支时关闭EPOLLIN，等令牌补齐后恢复
+    */
+    void setEgressLimit(double bytesPerSecond, double burstBytes);
+    void setIngressLimit(double bytesPerSecond, double burstBytes);
+    // 多个连接共享的限速器 用于TcpServer级别的总限速，和连接自己的限速同时生效
+    void setSharedLimiters(const TokenBucketPtr &egress, const TokenBucketPtr &ingress)
+    {
+        sharedEgress_ = egress;
+        sharedIngress_ = ingress;
+    }
+
+    /*
+    零停机重启 把连接交给新进程
+    fd为dup出来的副本，input/output是缓冲区中还没有处理/发送的数据，之后本进程按连接关闭处理但不shutdown
+    连接已经不在kConnected状态时fd为-1 cb在本连接的loop线程中执行
+    */
+    using HandoffCallback = std::function<void(int fd, const std::string &input, const std::string &output)>;
+    void handoff(const HandoffCallback &cb);
+    // 新进程接管连接时恢复缓冲区 必须在connectEstablished之前调用
+    void restoreBuffers(const std::string &input, const std::string &output);
+
+    /*
+    cork模式 send只追加到outputBuffer_，本轮事件循环结束时由EventLoop统一调用flushCorked，
+    一次回调中的多次send合并成一次write 只能在loop线程中调用
+    */
+    void setCorked(bool on);
+    bool corked() const { return corked_; }
+    void flushCorked();
+
+    // 输出缓冲区中还没有写入内核的字节数 只能在loop线程中调用
+    size_t pendingOutputBytes() const { return outputBuffer_.readableBytes(); }
+
+    /*
+    把连接迁移到target 可以在任意线程调用 迁移总是排到当前loop本轮事件处理之后执行
+    在旧loop中把Channel从EPollPoller中摘下，在target中重新注册，缓冲区和连接状态随对象一起转移，
+    旧loop队列中还没执行的send等调用会按顺序转发到target 只迁移kConnected状态的连接
+    注意setContext中保存的上层状态如果缓存了loop指针需要自己处理
+    */
+    void migrateTo(EventLoop *target);
+    // 处理读写事件累计花费的时间(包括消息回调) 供负载均衡统计 可以在任意线程调用
+    int64_t busyNanoSeconds() const { return busyNanoSeconds_.load(std::memory_order_relaxed); }
+
+    // 输入输出缓冲区底层存储的总大小 读写之后更新 可以在任意线程调用
+    size_t bufferBytes() const { return bufferBytes_.load(std::memory_order_relaxed); }
+    // 内存压力响应 可以在任意线程调用
+    // 超过软上限时暂停读取，和stopRead、反压分开计数
+    void setMemoryThrottled(bool on);
+    // 释放已经读完/发完的缓冲区 普通缓冲区读写完会自动释放，这里主要针对环形缓冲区
+    void shrinkBuffers();
+    /*
+    输入输出缓冲区改用BufferAllocator::mirrored()的环形缓冲区，关闭时换回所在loop的BufferArena
+    适合长时间流式收发、经常留下半个消息的连接，读写不再需要把剩余数据挪回缓冲区开头，
+    代价是每个缓冲区一个memfd映射，最小一页
+    只能在connectEstablished之前或者所在loop线程中调用
+    */
+    void setMirroredBuffers(bool on);
+
+    /*
+    本连接在所在loop上的句柄 只能在所在loop线程中调用，拷贝和析构都不需要原子操作
+    连接建立期间直接复用连接自己持有的锚点，其他时候临时创建一个
+    */
+    TcpConnectionHandle handle();
+
     void connectEstablished();
     void connectDestoryed();
 
@@ -78,16 +191,75 @@ private:
         kConnected,
         kDisconnecting
     };
+    enum MigrationE
+    {
+        kSettled,  // 没有在迁移
+        kDraining, // 旧loop还在处理迁移前排队的调用，新的调用暂存到pendingCalls_
+        kMoving    // 已经从旧loop摘下，还没有在新loop中注册
+    };
     void setState(StateE state) { state_ = state; }
+    EventLoop *loop() const { return loop_.load(std::memory_order_acquire); }
+    // 不在所属loop线程，或者正在等新loop的attachInLoop，InLoop函数需要通过queueInOwnerLoop重新排队
+    bool needsForward() const;
+    // 交给连接所属的loop按调用顺序执行 迁移期间先暂存，attachInLoop之后再依次执行
+    void runInOwnerLoop(std::function<void()> cb);
+    void queueInOwnerLoop(std::function<void()> cb);
+    void finishMigrateInLoop(EventLoop *target);
+    void runPendingCalls();
+    void setupChannel();
+    void migrateInLoop(EventLoop *target);
+    void attachInLoop(bool writing, bool resumeRead, bool restartStall);
+    void startStallTimer();
+    void setMemoryThrottledInLoop(bool on);
+    void shrinkBuffersInLoop();
+    void releaseIdleBuffer(Buffer *buf);
+    void anchorInLoop();
+    void unanchorInLoop();
+    void queueWriteComplete();
+    void updateBufferBytes()
+    {
+        bufferBytes_.store(inputBuffer_.internalCapacity() + outputBuffer_.internalCapacity(), std::memory_order_relaxed);
+    }
+    void addBusyTime(int64_t startNs)
+    {
+        // 只在loop线程中写 不需要原子加
+        busyNanoSeconds_.store(busyNanoSeconds_.load(std::memory_order_relaxed) +
+                                   Timestamp::monotonicNanoSeconds() - startNs,
+                               std::memory_order_relaxed);
+    }
     void handleRead(Timestamp receiveTime);
     void handleWrite();
     void handleClose();
     void handleError();
+    void writeOutputBuffer();
 
     void sendInLoop(const void *message, size_t len);
+    void sendStringInLoop(const std::string &message);
     void shutdownInLoop();
+    void forceCloseInLoop();
+    void handoffInLoop(const HandoffCallback &cb);
+    void startReadInLoop();
+    void stopReadInLoop();
+    // 反压计数 多个下游连接可以同时暂停同一个上游连接的读取
+    void throttleReadInLoop(bool on);
+    // 根据reading_和readThrottles_开关EPOLLIN
+    void updateReading();
+    void checkBackpressure();
+    void releaseBackpressure();
+    void handleStall();
+    // 返回本次最多可以发送的字节数 没有限速时直接返回want
+    size_t egressQuota(size_t want);
+    void refundEgress(size_t n);
+    void scheduleWriteResume();
+    void resumeWriting();
+    void chargeIngress(size_t n);
+    void resumeReading();
+    void cancelShapingTimers();
 
-    EventLoop *loop_; // TcpConnection都是在subloop里管理的
+    std::atomic<EventLoop *> loop_; // TcpConnection都是在subloop里管理的 迁移时改变
+    std::atomic_int migration_;     // MigrationE 只在所属loop线程中修改
+    std::mutex pendingMutex_;
+    std::vector<std::function<void()>> pendingCalls_; // 迁移期间的调用 保持调用顺序
     const std::string name_;
     std::atomic_int state_;
     bool reading_;
@@ -105,7 +277,41 @@ private:
     CloseCallback closeCallback_;
 
     size_t highWaterMark_;
+    int recvLowat_;
+
+    int readThrottles_;
+    size_t backpressureHigh_; // 0表示不开启自动反压
+    size_t backpressureLow_;
+    bool backpressured_;
+    std::weak_ptr<TcpConnection> backpressureSource_; // 为空或已关闭时暂停本连接
+    std::weak_ptr<TcpConnection> throttledConn_;      // 反压生效时实际被暂停读取的连接
+    size_t maxOutputBytes_;
+    double stallTimeout_;
+    TimerId stallTimer_;
+    bool stallTimerActive_;
+
+    std::unique_ptr<TokenBucket> egressLimit_;
+    std::unique_ptr<TokenBucket> ingressLimit_;
+    TokenBucketPtr sharedEgress_;
+    TokenBucketPtr sharedIngress_;
+    TimerId writeResumeTimer_;
+    TimerId readResumeTimer_;
+    bool writeResumeScheduled_;
+    bool readResumeScheduled_;
+
+    bool corked_;
+    bool flushQueued_; // 已经登记到EventLoop等待本轮结束时刷新
+    bool quickAck_;
+
+    std::atomic<int64_t> busyNanoSeconds_;
+    std::atomic<size_t> bufferBytes_;
+    bool memoryThrottled_;
 
     Buffer inputBuffer_;
     Buffer outputBuffer_;
+
+    std::shared_ptr<void> context_;
+
+    // 连接建立后在所在loop上的锚点 持有一个TcpConnectionPtr，事件回调期间保证连接有效，代替Channel::tie
+    TcpConnectionHandle anchorRef_;
 };
\ No newline at end of file
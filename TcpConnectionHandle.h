@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Callbacks.h"
+
+#include <utility>
+
+/*
+连接在所属loop上的引用计数 只在这个loop线程中修改，不需要原子操作
+计数大于0时通过conn持有一个TcpConnectionPtr，最后一个引用释放时一起释放
+连接建立后自己持有一个引用，事件回调、本loop内排队的回调都只增减这个计数，
+TcpConnectionPtr的原子计数只在锚点创建和释放时各修改一次
+连接迁移到其他loop时换一个新的锚点，旧loop上还没执行的回调继续在旧loop上释放旧锚点
+*/
+struct ConnectionAnchor
+{
+    explicit ConnectionAnchor(const TcpConnectionPtr &connArg) : refs(0), conn(connArg) {}
+
+    int refs;
+    TcpConnectionPtr conn;
+};
+
+/*
+loop内使用的连接句柄 拷贝和析构只修改ConnectionAnchor的普通计数
+只能在创建它的loop线程中拷贝和析构，需要交给其他线程时用share()换成TcpConnectionPtr
+*/
+class TcpConnectionHandle
+{
+public:
+    TcpConnectionHandle() : anchor_(nullptr) {}
+    explicit TcpConnectionHandle(ConnectionAnchor *anchor) : anchor_(anchor) { acquire(); }
+    TcpConnectionHandle(const TcpConnectionHandle &rhs) : anchor_(rhs.anchor_) { acquire(); }
+    TcpConnectionHandle(TcpConnectionHandle &&rhs) noexcept : anchor_(rhs.anchor_) { rhs.anchor_ = nullptr; }
+    ~TcpConnectionHandle() { release(); }
+
+    TcpConnectionHandle &operator=(TcpConnectionHandle rhs)
+    {
+        std::swap(anchor_, rhs.anchor_);
+        return *this;
+    }
+
+    void reset()
+    {
+        release();
+        anchor_ = nullptr;
+    }
+
+    TcpConnection *get() const { return anchor_ ? anchor_->conn.get() : nullptr; }
+    TcpConnection *operator->() const { return anchor_->conn.get(); }
+    TcpConnection &operator*() const { return *anchor_->conn; }
+    explicit operator bool() const { return anchor_ != nullptr; }
+
+    // 传给以const TcpConnectionPtr &为参数的回调 不修改原子计数 句柄存在期间有效
+    const TcpConnectionPtr &ptr() const { return anchor_->conn; }
+    // 跨线程的显式路径 返回的TcpConnectionPtr使用原子计数
+    TcpConnectionPtr share() const { return anchor_ ? anchor_->conn : TcpConnectionPtr(); }
+
+private:
+    void acquire()
+    {
+        if (anchor_)
+        {
+            ++anchor_->refs;
+        }
+    }
+
+    void release()
+    {
+        if (anchor_ && --anchor_->refs == 0)
+        {
+            delete anchor_;
+        }
+    }
+
+    ConnectionAnchor *anchor_;
+};
@@ -1,9 +1,14 @@
 #include "TcpServer.h"
 #include "Logger.h"
 #include "TcpConnection.h"
+#include "Channel.h"
+#include "SocketHandoff.h"
 
 #include <functional>
+#include <vector>
+#include <algorithm>
 #include <strings.h>
+#include <unistd.h>
 
 EventLoop *CheckLoopNotNull(EventLoop *loop)
 {
@@ -22,8 +27,17 @@ TcpServer::TcpServer(EventLoop *loop, const InetAddress &listenAddr, const std::
       threadPool_(new EventLoopThreadPool(loop, name_)),
       connectionCallback_(),
       messageCallback_(),
-      nextConnId_(1),
-      started_(0)
+      mirroredBuffers_(false),
+      transferConnections_(false),
+      handoffListenFd_(-1),
+      pendingHandoffs_(0),
+      handedOff_(false),
+      started_(0),
+      rebalanceInterval_(0),
+      rebalanceImbalance_(0.3),
+      lastRebalanceNs_(0),
+      memoryCheckInterval_(0),
+      nextConnId_(1)
 {
     // 当有新用户连接时，会执行TcpServer::newConnection 回调
     acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection, this,
@@ -32,6 +46,14 @@ TcpServer::TcpServer(EventLoop *loop, const InetAddress &listenAddr, const std::
 
 TcpServer::~TcpServer()
 {
+    if (rebalanceInterval_ > 0 && started_)
+    {
+        loop_->cancel(rebalanceTimer_);
+    }
+    if (memoryCheckInterval_ > 0 && started_)
+    {
+        loop_->cancel(memoryCheckTimer_);
+    }
     for (auto &item : connections_)
     {
         TcpConnectionPtr conn(item.second); // 这个局部的shared_ptr智能指针对象，出右括号可以自动释放new处理的TcpConnection对象资源
@@ -40,6 +62,13 @@ TcpServer::~TcpServer()
         // 销毁连接
         conn->getLoop()->runInLoop(std::bind(&TcpConnection::connectDestoryed, conn));
     }
+
+    if (handoffListenFd_ >= 0)
+    {
+        handoffChannel_->disableAll();
+        handoffChannel_->remove();
+        ::close(handoffListenFd_);
+    }
 }
 
 void TcpServer::start()
@@ -47,21 +76,231 @@ void TcpServer::start()
     if (started_++ == 0) // 防止一个TcpServer对象被start多次
     {
         threadPool_->start(threadInitCallback_); // 启动底层的loop线程池
+        startRebalancing();
+        startMemoryCheck();
         loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
     }
 }
 
+void TcpServer::startRebalancing()
+{
+    if (rebalanceInterval_ > 0)
+    {
+        rebalanceTimer_ = loop_->runEvery(rebalanceInterval_, std::bind(&TcpServer::rebalance, this));
+    }
+}
+
+// 在baseloop中执行 connections_只在baseloop中访问
+void TcpServer::rebalance()
+{
+    std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+    int64_t now = Timestamp::monotonicNanoSeconds();
+    int64_t elapsed = now - lastRebalanceNs_;
+    bool firstSample = lastRebalanceNs_ == 0;
+    lastRebalanceNs_ = now;
+
+    EventLoop *busiest = nullptr;
+    EventLoop *idlest = nullptr;
+    double maxLoad = 0;
+    double minLoad = 0;
+    for (EventLoop *ioLoop : loops)
+    {
+        int64_t busy = ioLoop->busyNanoSeconds();
+        double load = static_cast<double>(busy - lastBusyNs_[ioLoop]) / elapsed;
+        lastBusyNs_[ioLoop] = busy;
+        if (!busiest || load > maxLoad)
+        {
+            busiest = ioLoop;
+            maxLoad = load;
+        }
+        if (!idlest || load < minLoad)
+        {
+            idlest = ioLoop;
+            minLoad = load;
+        }
+    }
+
+    /*
+    统计每个连接这段时间的处理耗时，在最忙loop上选最重的连接，要求迁移后目标loop的负载仍比现在的最高负载低imbalance以上，
+    避免把一个重连接在loop之间来回搬动
+    */
+    bool balanced = firstSample || loops.size() < 2 || maxLoad - minLoad < rebalanceImbalance_;
+    std::unordered_map<TcpConnection *, int64_t> connBusy;
+    TcpConnectionPtr heaviest;
+    double heaviestLoad = 0;
+    size_t busiestConnections = 0;
+    for (auto &item : connections_)
+    {
+        const TcpConnectionPtr &conn = item.second;
+        int64_t total = conn->busyNanoSeconds();
+        auto it = lastConnBusyNs_.find(conn.get());
+        int64_t delta = it == lastConnBusyNs_.end() ? total : total - it->second;
+        connBusy[conn.get()] = total;
+        double load = static_cast<double>(delta) / elapsed;
+        if (conn->getLoop() == busiest)
+        {
+            ++busiestConnections;
+        }
+        if (!balanced && conn->getLoop() == busiest && load > heaviestLoad &&
+            minLoad + load <= maxLoad - rebalanceImbalance_)
+        {
+            heaviest = conn;
+            heaviestLoad = load;
+        }
+    }
+    lastConnBusyNs_.swap(connBusy);
+
+    // 只有一个连接的loop搬走它也只是把负载换到另一个loop
+    if (!heaviest || busiestConnections < 2)
+    {
+        return;
+    }
+    LOG_INFO("TcpServer[%s] rebalance: loop %p load %.2f, loop %p load %.2f, migrate %s load %.2f \n",
+             name_.c_str(), busiest, maxLoad, idlest, minLoad, heaviest->name().c_str(), heaviestLoad);
+    heaviest->migrateTo(idlest);
+}
+
+void TcpServer::setMemoryLimits(size_t softLimit, size_t hardLimit, double checkInterval)
+{
+    BufferAccountant::instance().setLimits(softLimit, hardLimit);
+    memoryCheckInterval_ = (softLimit > 0 || hardLimit > 0) ? checkInterval : 0;
+}
+
+void TcpServer::startMemoryCheck()
+{
+    if (memoryCheckInterval_ > 0)
+    {
+        memoryCheckTimer_ = loop_->runEvery(memoryCheckInterval_, std::bind(&TcpServer::checkMemory, this));
+    }
+}
+
+// 在baseloop中执行
+void TcpServer::checkMemory()
+{
+    BufferAccountant &accountant = BufferAccountant::instance();
+    int64_t total = accountant.totalBytes();
+    int64_t soft = static_cast<int64_t>(accountant.softLimit());
+    int64_t hard = static_cast<int64_t>(accountant.hardLimit());
+    bool overSoft = soft > 0 && total >= soft;
+    bool overHard = hard > 0 && total >= hard;
+
+    // 清掉已经关闭的连接 避免表项一直累积
+    for (auto it = memoryThrottled_.begin(); it != memoryThrottled_.end();)
+    {
+        if (it->second.expired())
+        {
+            it = memoryThrottled_.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    if (!overSoft && !overHard)
+    {
+        // 降到软上限的90%以下再恢复读取，避免在上限附近反复开关
+        if (!memoryThrottled_.empty() && (soft == 0 || total < soft / 10 * 9))
+        {
+            LOG_INFO("TcpServer[%s] buffer memory %ld bytes, resume %lu connections \n",
+                     name_.c_str(), total, memoryThrottled_.size());
+            for (auto &item : memoryThrottled_)
+            {
+                TcpConnectionPtr conn = item.second.lock();
+                if (conn)
+                {
+                    conn->setMemoryThrottled(false);
+                }
+            }
+            memoryThrottled_.clear();
+        }
+        return;
+    }
+
+    // bufferBytes在IO线程中随时变化 先取快照再排序 否则比较结果前后不一致
+    std::vector<std::pair<size_t, TcpConnectionPtr>> conns;
+    conns.reserve(connections_.size());
+    for (auto &item : connections_)
+    {
+        item.second->shrinkBuffers();
+        conns.push_back(std::make_pair(item.second->bufferBytes(), item.second));
+    }
+    std::sort(conns.begin(), conns.end(), [](const std::pair<size_t, TcpConnectionPtr> &a, const std::pair<size_t, TcpConnectionPtr> &b)
+              { return a.first > b.first; });
+
+    size_t next = 0;
+    if (overHard)
+    {
+        int64_t excess = total - hard;
+        for (; next < conns.size() && excess > 0; ++next)
+        {
+            const TcpConnectionPtr &conn = conns[next].second;
+            LOG_ERROR("TcpServer[%s] buffer memory %ld bytes over hard limit, close %s holding %lu bytes \n",
+                      name_.c_str(), total, conn->name().c_str(), conns[next].first);
+            excess -= static_cast<int64_t>(conns[next].first);
+            memoryThrottled_.erase(conn->name());
+            conn->forceClose();
+            accountant.recordEvicted();
+        }
+    }
+    if (soft > 0)
+    {
+        int64_t excess = total - soft;
+        for (size_t i = next; i < conns.size() && excess > 0; ++i)
+        {
+            const TcpConnectionPtr &conn = conns[i].second;
+            excess -= static_cast<int64_t>(conns[i].first);
+            if (memoryThrottled_.insert(std::make_pair(conn->name(), std::weak_ptr<TcpConnection>(conn))).second)
+            {
+                conn->setMemoryThrottled(true);
+                accountant.recordThrottled();
+            }
+        }
+    }
+}
+
 void TcpServer::setThreadNum(int numThreads)
 {
     threadPool_->setThreadNum(numThreads);
 }
 
+void TcpServer::setSocketOptions(const SocketOptions &options)
+{
+    socketOptions_ = options;
+    acceptor_->setSocketOptions(options);
+}
+
+void TcpServer::setEgressLimit(double bytesPerSecond, double burstBytes)
+{
+    egressLimiter_.reset(bytesPerSecond > 0 ? new TokenBucket(bytesPerSecond, burstBytes) : nullptr);
+}
+
+void TcpServer::setIngressLimit(double bytesPerSecond, double burstBytes)
+{
+    ingressLimiter_.reset(bytesPerSecond > 0 ? new TokenBucket(bytesPerSecond, burstBytes) : nullptr);
+}
+
 // 有一个新的客户端的连接，acceptor会执行这个回调操作
 void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
+{
+    if (memoryCheckInterval_ > 0 && BufferAccountant::instance().pressure() == BufferAccountant::kHard)
+    {
+        // 超过硬上限 不再接受新连接
+        LOG_ERROR("TcpServer[%s] buffer memory over hard limit, refuse %s \n", name_.c_str(), peerAddr.toIpPort().c_str());
+        BufferAccountant::instance().recordRefusedAccept();
+        ::close(sockfd);
+        return;
+    }
+    TcpConnectionPtr conn = createConnection(sockfd, peerAddr);
+    // 直接调用TcpConnection::connectEstablished
+    conn->getLoop()->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
+}
+
+TcpConnectionPtr TcpServer::createConnection(int sockfd, const InetAddress &peerAddr)
 {
     // 轮询算法，选择一个subloop来管理对应的channel
     EventLoop *ioLoop = threadPool_->getNextLoop();
-    char buf[64] = {0};
+    char buf[128] = {0};
     snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_);
     ++nextConnId_;
     std::string connName = name_ + buf;
@@ -70,16 +309,7 @@ void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
              name_.c_str(), connName.c_str(), peerAddr.toIpPort().c_str());
 
     // 通过sockfd获取绑定的本机ip地址和端口
-    sockaddr_in local;
-    bzero(&local, sizeof local);
-
-    socklen_t addrlen = sizeof local;
-    if (::getsockname(sockfd, (sockaddr *)&local, &addrlen) < 0)
-        ;
-    {
-        LOG_ERROR("sockets::getLocalAddr");
-    }
-    InetAddress localAddr(local);
+    InetAddress localAddr = InetAddress::localAddressOf(sockfd);
 
     // 根据连接成功的sockfd，创建Tcpconnection连接对象
     TcpConnectionPtr conn(new TcpConnection(
@@ -94,11 +324,18 @@ void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
     conn->setConnectionCallback(connectionCallback_);
     conn->setMessageCallback(messageCallback_);
     conn->setWriteCompleteCallbac(writeCompleteCallback_);
+    conn->setSharedLimiters(egressLimiter_, ingressLimiter_);
+    if (socketOptions_.quickAck && !localAddr.isUnixDomain())
+    {
+        conn->setQuickAck(true);
+    }
+    if (mirroredBuffers_)
+    {
+        conn->setMirroredBuffers(true); // 连接还没有交给ioLoop，可以在这里直接替换
+    }
     // 设置了如何关闭连接的回调
     conn->setCloseCallback(std::bind(&TcpServer::removeConnection, this, std::placeholders::_1));
-
-    // 直接调用TcpConnection::connectEstablished
-    ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
+    return conn;
 }
 
 void TcpServer::removeConnection(const TcpConnectionPtr &conn)
@@ -113,4 +350,167 @@ void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn)
     size_t n = connections_.erase(conn->name());
     EventLoop *ioLoop = conn->getLoop();
     ioLoop->queueInLoop(std::bind(&TcpConnection::connectDestoryed, conn));
+    checkDrained();
+}
+
+void TcpServer::enableHandoff(const std::string &path, bool transferConnections)
+{
+    handoffPath_ = path;
+    transferConnections_ = transferConnections;
+    loop_->runInLoop(std::bind(&TcpServer::enableHandoffInLoop, this));
+}
+
+void TcpServer::enableHandoffInLoop()
+{
+    handoffListenFd_ = SocketHandoff::listen(handoffPath_);
+    if (handoffListenFd_ < 0)
+    {
+        return;
+    }
+    handoffChannel_.reset(new Channel(loop_, handoffListenFd_));
+    handoffChannel_->setReadCallback(std::bind(&TcpServer::handleHandoffRequest, this));
+    handoffChannel_->enableReading();
+}
+
+// 新进程连上来了 只处理一次交接
+void TcpServer::handleHandoffRequest()
+{
+    int fd = ::accept4(handoffListenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0)
+    {
+        LOG_ERROR("TcpServer::handleHandoffRequest accept err:%d \n", errno);
+        return;
+    }
+    handoffChannel_->disableAll();
+    handoffChannel_->remove();
+    ::close(handoffListenFd_);
+    handoffListenFd_ = -1;
+
+    handoff_.reset(new SocketHandoff(fd));
+    if (!handoff_->sendListenSocket(acceptor_->fd()))
+    {
+        handoff_.reset();
+        return;
+    }
+    // 新进程从同一个监听队列accept，本进程不再接受新连接
+    acceptor_->stopListening();
+    handedOff_ = true;
+
+    std::vector<TcpConnectionPtr> conns;
+    if (transferConnections_)
+    {
+        for (auto &item : connections_)
+        {
+            conns.push_back(item.second);
+        }
+    }
+    LOG_INFO("TcpServer::handleHandoffRequest [%s] - handing off listen socket and %lu connections \n",
+             name_.c_str(), conns.size());
+
+    pendingHandoffs_ = conns.size();
+    if (conns.empty())
+    {
+        finishHandoff();
+        return;
+    }
+    for (const TcpConnectionPtr &conn : conns)
+    {
+        conn->handoff([this](int connfd, const std::string &input, const std::string &output)
+                      { loop_->runInLoop(std::bind(&TcpServer::sendHandedOffConnection, this, connfd, input, output)); });
+    }
+}
+
+void TcpServer::sendHandedOffConnection(int fd, const std::string &input, const std::string &output)
+{
+    if (fd >= 0)
+    {
+        if (handoff_ && !handoff_->sendConnection(fd, input, output))
+        {
+            LOG_ERROR("TcpServer::sendHandedOffConnection [%s] - connection lost during handoff \n", name_.c_str());
+        }
+        ::close(fd);
+    }
+    if (--pendingHandoffs_ == 0)
+    {
+        finishHandoff();
+    }
+}
+
+void TcpServer::finishHandoff()
+{
+    if (handoff_)
+    {
+        handoff_->sendDone();
+        handoff_.reset();
+    }
+    checkDrained();
+}
+
+void TcpServer::checkDrained()
+{
+    if (handedOff_ && !handoff_ && connections_.empty())
+    {
+        handedOff_ = false; // 只通知一次
+        LOG_INFO("TcpServer [%s] - drained after handoff \n", name_.c_str());
+        if (drainedCallback_)
+        {
+            drainedCallback_();
+        }
+    }
+}
+
+bool TcpServer::startFromHandoff(const std::string &path)
+{
+    if (started_++ != 0)
+    {
+        return false;
+    }
+    threadPool_->start(threadInitCallback_);
+    startRebalancing();
+    startMemoryCheck();
+    bool adopted = receiveHandoff(path);
+    loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+    return adopted;
+}
+
+// 阻塞接收旧进程交出来的socket 在loop()之前于baseloop线程中调用
+bool TcpServer::receiveHandoff(const std::string &path)
+{
+    int fd = SocketHandoff::connect(path);
+    if (fd < 0)
+    {
+        return false;
+    }
+    SocketHandoff handoff(fd);
+    SocketHandoff::Message msg;
+    bool gotListenSocket = false;
+    int adopted = 0;
+    while (handoff.receive(&msg) && msg.type != SocketHandoff::kDone)
+    {
+        if (msg.type == SocketHandoff::kListenSocket && msg.fd >= 0)
+        {
+            // 构造时bind的socket还没有listen，直接换成旧进程的监听socket
+            acceptor_.reset(new Acceptor(loop_, msg.fd));
+            acceptor_->setSocketOptions(socketOptions_);
+            acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection, this,
+                                                          std::placeholders::_1, std::placeholders::_2));
+            gotListenSocket = true;
+        }
+        else if (msg.type == SocketHandoff::kConnection)
+        {
+            TcpConnectionPtr conn = createConnection(msg.fd, InetAddress::peerAddressOf(msg.fd));
+            std::string input;
+            std::string output;
+            input.swap(msg.input);
+            output.swap(msg.output);
+            conn->getLoop()->runInLoop([conn, input, output]()
+                                       {
+                                           conn->restoreBuffers(input, output);
+                                           conn->connectEstablished(); });
+            ++adopted;
+        }
+    }
+    LOG_INFO("TcpServer::startFromHandoff [%s] - listen socket %s, %d connections adopted \n",
+             name_.c_str(), gotListenSocket ? "adopted" : "missing", adopted);
+    return gotListenSocket;
 }
\ No newline at end of file
@@ -8,6 +8,8 @@
 #include "Callbacks.h"
 #include "TcpConnection.h"
 #include "Buffer.h"
+#include "TokenBucket.h"
+#include "BufferAccountant.h"
 
 #include <functional>
 #include <string>
@@ -15,10 +17,15 @@
 #include <atomic>
 #include <unordered_map>
 
+class Channel;
+class SocketHandoff;
+
 class TcpServer : noncopyable
 {
 public:
     using ThreadInitCallback = std::function<void(EventLoop *)>;
+    // 交接完成并且本进程的连接全部关闭后回调，通常在这里quit并退出进程
+    using DrainedCallback = std::function<void()>;
 
     enum Option
     {
@@ -37,11 +44,65 @@ public:
     void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
     void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
 
+    // 所有连接加起来的总限速 多个subloop共享同一个令牌桶 bytesPerSecond小于等于0表示不限速
+    // 必须在start之前设置，单个连接的限速在连接回调中调用TcpConnection::setEgressLimit/setIngressLimit
+    void setEgressLimit(double bytesPerSecond, double burstBytes);
+    void setIngressLimit(double bytesPerSecond, double burstBytes);
+
+    // socket参数 必须在start之前设置
+    void setSocketOptions(const SocketOptions &options);
+    // 新连接的输入输出缓冲区使用镜像映射的环形缓冲区 见TcpConnection::setMirroredBuffers
+    void setMirroredBuffers(bool on) { mirroredBuffers_ = on; }
+
+    /*
+    自动负载均衡 每隔interval秒统计一次各个subloop的繁忙比例，
+    最忙和最闲的loop相差超过imbalance(0~1)时，把最忙loop上这段时间处理耗时最多的连接迁移到最闲的loop
+    每次最多迁移一个连接，loop上只有一个连接时不迁移 必须在start之前设置
+    */
+    void enableRebalancing(double interval, double imbalance = 0.3)
+    {
+        rebalanceInterval_ = interval;
+        rebalanceImbalance_ = imbalance;
+    }
+
+    /*
+    进程内所有Buffer的内存上限 0表示不限制 必须在start之前设置
+    每隔checkInterval秒检查一次BufferAccountant的总量：
+    超过软上限时收缩空闲缓冲区，并按缓冲区占用从大到小暂停连接的读取，直到暂停的连接覆盖超出的部分，降到软上限的90%以下后恢复；
+    超过硬上限时新连接accept后直接关闭，并从占用最大的连接开始强制关闭，直到覆盖超出的部分
+    */
+    void setMemoryLimits(size_t softLimit, size_t hardLimit, double checkInterval = 0.1);
+    BufferAccountant::Stats memoryStats() const { return BufferAccountant::instance().stats(); }
+
     // 开启服务器监听
     void start();
 
+    /*
+    零停机重启
+    旧进程: enableHandoff在path上等待新进程，新进程连上后把监听fd交出去并停止accept，
+            transferConnections为true时把已建立的连接连同缓冲区数据一起交出去，否则等现有连接自然结束
+    新进程: 用startFromHandoff代替start，从path上的旧进程接管监听fd和连接，没有旧进程时等同于start
+    监听队列由同一个内核socket持有，交接期间不会丢SYN
+    只迁移socket和Buffer中的数据，setContext保存的协议状态不会迁移
+    */
+    void enableHandoff(const std::string &path, bool transferConnections);
+    bool startFromHandoff(const std::string &path);
+    void setDrainedCallback(const DrainedCallback &cb) { drainedCallback_ = cb; }
+
 private:
     void newConnection(int sockfd, const InetAddress &peerAddr);
+    TcpConnectionPtr createConnection(int sockfd, const InetAddress &peerAddr);
+    // 以下在baseloop中执行
+    bool receiveHandoff(const std::string &path);
+    void enableHandoffInLoop();
+    void handleHandoffRequest();
+    void sendHandedOffConnection(int fd, const std::string &input, const std::string &output);
+    void finishHandoff();
+    void checkDrained();
+    void startRebalancing();
+    void startMemoryCheck();
+    void checkMemory();
+    void rebalance();
     void removeConnection(const TcpConnectionPtr &conn);
     void removeConnectionInLoop(const TcpConnectionPtr &conn);
 
@@ -59,8 +120,33 @@ private:
     WriteCompleteCallback writeCompleteCallback_; // 消息发送完成后的回调
 
     ThreadInitCallback threadInitCallback_; // loop线程初始化的回调
+
+    SocketOptions socketOptions_;
+    TokenBucketPtr egressLimiter_;
+    TokenBucketPtr ingressLimiter_;
+    bool mirroredBuffers_;
+
+    std::string handoffPath_;
+    bool transferConnections_;
+    int handoffListenFd_;
+    std::unique_ptr<Channel> handoffChannel_;
+    std::unique_ptr<SocketHandoff> handoff_; // 正在进行的交接
+    size_t pendingHandoffs_;                 // 还没有交出去的连接数
+    bool handedOff_;                         // 监听fd已经交给新进程
+    DrainedCallback drainedCallback_;
     std::atomic_int started_;
 
+    double rebalanceInterval_; // 小于等于0表示不开启
+    double rebalanceImbalance_;
+    TimerId rebalanceTimer_;
+    int64_t lastRebalanceNs_;
+    std::unordered_map<EventLoop *, int64_t> lastBusyNs_;
+    std::unordered_map<TcpConnection *, int64_t> lastConnBusyNs_;
+
+    double memoryCheckInterval_; // 小于等于0表示不检查
+    TimerId memoryCheckTimer_;
+    std::unordered_map<std::string, std::weak_ptr<TcpConnection>> memoryThrottled_; // 按连接名索引 地址可能被新连接复用
+
     int nextConnId_;
     ConnectionMap connections_; // 保存所有的连接
 };
\ No newline at end of file
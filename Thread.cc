@@ -46,6 +46,7 @@ int Thread::join()
 {
     joined_ = true;
     thread_->join();
+    return 0;
 }
 
 void Thread::setDefaultName()
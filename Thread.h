@@ -3,6 +3,7 @@
 #include "noncopyable.h"
 
 #include <functional>
+#include <string>
 #include <thread>
 #include <memory>
 #include <unistd.h>
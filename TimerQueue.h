@@ -0,0 +1,54 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Timestamp.h"
+#include "Callbacks.h"
+#include "Channel.h"
+
+#include <set>
+#include <vector>
+#include <utility>
+
+class EventLoop;
+class Timer;
+class TimerId;
+
+/*
+定时器队列 底层使用timerfd，到期事件和普通IO事件一样由Poller统一分发
+只能在所属loop线程中操作，跨线程调用通过runInLoop转发
+*/
+class TimerQueue : noncopyable
+{
+public:
+    explicit TimerQueue(EventLoop *loop);
+    ~TimerQueue();
+
+    // 线程安全 可以在其他线程中调用
+    TimerId addTimer(TimerCallback cb, Timestamp when, double interval);
+    void cancel(TimerId timerId);
+
+private:
+    using Entry = std::pair<Timestamp, Timer *>;
+    using TimerList = std::set<Entry>;
+    using ActiveTimer = std::pair<Timer *, int64_t>;
+    using ActiveTimerSet = std::set<ActiveTimer>;
+
+    void addTimerInLoop(Timer *timer);
+    void cancelInLoop(TimerId timerId);
+    // timerfd可读 说明有定时器到期了
+    void handleRead();
+    // 取出所有到期的定时器
+    std::vector<Entry> getExpired(Timestamp now);
+    void reset(const std::vector<Entry> &expired, Timestamp now);
+
+    bool insert(Timer *timer);
+
+    EventLoop *loop_;
+    const int timerfd_;
+    Channel timerfdChannel_;
+    TimerList timers_; // 按到期时间排序
+
+    ActiveTimerSet activeTimers_; // 与timers_保存相同的定时器，按地址排序，用于cancel
+    bool callingExpiredTimers_;
+    ActiveTimerSet cancelingTimers_; // 在回调中被取消的定时器
+};
@@ -8,26 +8,41 @@ Timestamp::Timestamp(int64_t microSecondsSinceEpoch) : microSecondsSinceEpoch_(m
 
 Timestamp Timestamp::now()
 {
-    return Timestamp(time(nullptr));
+    // 定时器需要亚秒级的精度，time(nullptr)只能精确到秒
+    struct timespec ts;
+    ::clock_gettime(CLOCK_REALTIME, &ts);
+    return Timestamp(static_cast<int64_t>(ts.tv_sec) * kMicroSecondsPerSecond + ts.tv_nsec / 1000);
 }
 
-std::string Timestamp::toString() const
+Timestamp Timestamp::monotonic()
 {
-    char buf[128] = {0};
-    tm *tm_time = localtime(&microSecondsSinceEpoch_);
-    snprintf(buf, 128, "%4d/%02d/%02d %02d:%02d:%02d",
-             tm_time->tm_year + 1900,
-             tm_time->tm_mon + 1,
-             tm_time->tm_mday,
-             tm_time->tm_hour,
-             tm_time->tm_min,
-             tm_time->tm_sec);
-    return buf;
+    return Timestamp(monotonicNanoSeconds() / 1000);
+}
+
+int64_t Timestamp::monotonicNanoSeconds()
+{
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * kNanoSecondsPerSecond + ts.tv_nsec;
 }
 
-#include <iostream>
-int main()
+std::string Timestamp::toString(bool showMicroseconds) const
 {
-    std::cout << Timestamp::now().toString() << std::endl;
-    return 0;
-}
\ No newline at end of file
+    char buf[64] = {0};
+    time_t seconds = secondsSinceEpoch();
+    struct tm tm_time;
+    ::localtime_r(&seconds, &tm_time); // localtime返回静态缓冲区 多线程下不安全
+    int len = snprintf(buf, sizeof buf, "%4d/%02d/%02d %02d:%02d:%02d",
+                       tm_time.tm_year + 1900,
+                       tm_time.tm_mon + 1,
+                       tm_time.tm_mday,
+                       tm_time.tm_hour,
+                       tm_time.tm_min,
+                       tm_time.tm_sec);
+    if (showMicroseconds)
+    {
+        int microseconds = static_cast<int>(microSecondsSinceEpoch_ % kMicroSecondsPerSecond);
+        snprintf(buf + len, sizeof buf - len, ".%06d", microseconds);
+    }
+    return buf;
+}
@@ -8,9 +8,47 @@ class Timestamp
 public:
     Timestamp();
     explicit Timestamp(int64_t microSecondsSinceEpoch);
-    static Timestamp now();
-    std::string toString() const;
+    static Timestamp now(); // 墙上时间 clock_gettime走vDSO 不陷入内核
+    static Timestamp invalid() { return Timestamp(); }
+    // 单调时钟 不受系统改时影响 只用于计算时间间隔 不能和now()混用
+    static Timestamp monotonic();
+    static int64_t monotonicNanoSeconds();
+    std::string toString(bool showMicroseconds = false) const;
+
+    bool valid() const { return microSecondsSinceEpoch_ > 0; }
+    int64_t microSecondsSinceEpoch() const { return microSecondsSinceEpoch_; }
+    time_t secondsSinceEpoch() const
+    {
+        return static_cast<time_t>(microSecondsSinceEpoch_ / kMicroSecondsPerSecond);
+    }
+
+    static const int kMicroSecondsPerSecond = 1000 * 1000;
+    static const int64_t kNanoSecondsPerSecond = 1000 * 1000 * 1000;
 
 private:
     int64_t microSecondsSinceEpoch_;
-};
\ No newline at end of file
+};
+
+inline bool operator<(Timestamp lhs, Timestamp rhs)
+{
+    return lhs.microSecondsSinceEpoch() < rhs.microSecondsSinceEpoch();
+}
+
+inline bool operator==(Timestamp lhs, Timestamp rhs)
+{
+    return lhs.microSecondsSinceEpoch() == rhs.microSecondsSinceEpoch();
+}
+
+// 两个时间点的差值 单位秒
+inline double timeDifference(Timestamp high, Timestamp low)
+{
+    int64_t diff = high.microSecondsSinceEpoch() - low.microSecondsSinceEpoch();
+    return static_cast<double>(diff) / Timestamp::kMicroSecondsPerSecond;
+}
+
+// 在timestamp的基础上加上seconds秒
+inline Timestamp addTime(Timestamp timestamp, double seconds)
+{
+    int64_t delta = static_cast<int64_t>(seconds * Timestamp::kMicroSecondsPerSecond);
+    return Timestamp(timestamp.microSecondsSinceEpoch() + delta);
+}
@@ -0,0 +1,58 @@
+#include "TokenBucket.h"
+
+#include <algorithm>
+
+TokenBucket::TokenBucket(double bytesPerSecond, double burstBytes)
+    : rate_(bytesPerSecond),
+      burst_(burstBytes),
+      nanosPerByte_(1e9 / bytesPerSecond),
+      burstNanos_(static_cast<int64_t>(burstBytes * 1e9 / bytesPerSecond)),
+      tat_(0)
+{
+}
+
+size_t TokenBucket::consume(size_t want, Timestamp now)
+{
+    const int64_t nowNanos = toNanos(now);
+    int64_t tat = tat_.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        // tat落后于当前时间说明桶已经满了
+        int64_t base = std::max(tat, nowNanos);
+        int64_t budget = nowNanos + burstNanos_ - base;
+        if (budget <= 0)
+        {
+            return 0;
+        }
+        size_t grant = std::min(want, static_cast<size_t>(static_cast<double>(budget) / nanosPerByte_));
+        if (grant == 0)
+        {
+            return 0;
+        }
+        if (tat_.compare_exchange_weak(tat, base + costOf(grant), std::memory_order_relaxed))
+        {
+            return grant;
+        }
+    }
+}
+
+void TokenBucket::charge(size_t n, Timestamp now)
+{
+    const int64_t nowNanos = toNanos(now);
+    int64_t tat = tat_.load(std::memory_order_relaxed);
+    while (!tat_.compare_exchange_weak(tat, std::max(tat, nowNanos) + costOf(n), std::memory_order_relaxed))
+    {
+    }
+}
+
+void TokenBucket::refund(size_t n)
+{
+    tat_.fetch_sub(costOf(n), std::memory_order_relaxed);
+}
+
+double TokenBucket::delay(size_t need, Timestamp now) const
+{
+    need = std::min(need, static_cast<size_t>(burst_));
+    int64_t wait = tat_.load(std::memory_order_relaxed) + costOf(need) - burstNanos_ - toNanos(now);
+    return wait > 0 ? static_cast<double>(wait) / 1e9 : 0.0;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Timestamp.h"
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+令牌桶限速 rate为每秒字节数，burst为桶容量(最大突发字节数)
+用GCRA的方式实现: 只记录一个理论到达时间tat_，取令牌就是把tat_往后推
+整个状态是一个原子变量，可以被多个IO线程共享(TcpServer级别的总限速)，每次读写只需要一次CAS
+*/
+class TokenBucket : noncopyable
+{
+public:
+    TokenBucket(double bytesPerSecond, double burstBytes);
+
+    double rate() const { return rate_; }
+    double burst() const { return burst_; }
+
+    // 最多取走want个令牌，返回实际取到的数量，令牌不足时返回0
+    size_t consume(size_t want, Timestamp now);
+    // 不管是否足够都扣除n个令牌，可以透支，透支的部分需要之后等待补齐
+    void charge(size_t n, Timestamp now);
+    // 归还consume取走但没有用掉的令牌
+    void refund(size_t n);
+    // 至少有need个令牌(不超过burst)还需要等待多少秒
+    double delay(size_t need, Timestamp now) const;
+
+private:
+    static int64_t toNanos(Timestamp t) { return t.microSecondsSinceEpoch() * 1000; }
+    int64_t costOf(size_t bytes) const { return static_cast<int64_t>(static_cast<double>(bytes) * nanosPerByte_); }
+
+    const double rate_;
+    const double burst_;
+    const double nanosPerByte_;
+    const int64_t burstNanos_; // 桶满时对应的时间长度
+    std::atomic<int64_t> tat_; // theoretical arrival time 纳秒
+};
+
+using TokenBucketPtr = std::shared_ptr<TokenBucket>;
@@ -0,0 +1,66 @@
+#include "UdpServer.h"
+#include "Logger.h"
+
+static EventLoop *CheckLoopNotNull(EventLoop *loop)
+{
+    if (loop == nullptr)
+    {
+        LOG_FATAL("%s:%s:%d mainloop is null ! \n", __FILE__, __FUNCTION__, __LINE__);
+    }
+    return loop;
+}
+
+UdpServer::UdpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &nameArg, size_t maxDatagramSize)
+    : loop_(CheckLoopNotNull(loop)),
+      listenAddr_(listenAddr),
+      name_(nameArg),
+      maxDatagramSize_(maxDatagramSize),
+      threadPool_(new EventLoopThreadPool(loop, name_)),
+      groEnabled_(false),
+      started_(0)
+{
+}
+
+UdpServer::~UdpServer()
+{
+    // UdpSocket需要在自己的loop线程中从poller里移除
+    for (auto &socket : sockets_)
+    {
+        UdpSocket *s = socket.release();
+        s->getLoop()->runInLoop([s]()
+                                { delete s; });
+    }
+}
+
+void UdpServer::setThreadNum(int numThreads)
+{
+    threadPool_->setThreadNum(numThreads);
+}
+
+void UdpServer::start()
+{
+    if (started_++ == 0)
+    {
+        threadPool_->start(threadInitCallback_);
+        std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+        for (EventLoop *ioLoop : loops)
+        {
+            UdpSocket *socket = new UdpSocket(ioLoop, listenAddr_, true, maxDatagramSize_);
+            socket->setDatagramCallback(datagramCallback_);
+            socket->setSegmentedDatagramCallback(segmentedDatagramCallback_);
+            sockets_.push_back(std::unique_ptr<UdpSocket>(socket));
+            ioLoop->runInLoop(std::bind(&UdpServer::startSocketInLoop, this, socket));
+        }
+        LOG_INFO("UdpServer[%s] listening on %s with %lu sockets \n", name_.c_str(),
+                 listenAddr_.toIpPort().c_str(), sockets_.size());
+    }
+}
+
+void UdpServer::startSocketInLoop(UdpSocket *socket)
+{
+    if (groEnabled_)
+    {
+        socket->enableGro();
+    }
+    socket->start();
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "EventLoop.h"
+#include "InetAddress.h"
+#include "EventLoopThreadPool.h"
+#include "UdpSocket.h"
+#include "Callbacks.h"
+
+#include <functional>
+#include <string>
+#include <memory>
+#include <vector>
+#include <atomic>
+
+/*
+UDP服务器 每个subloop各自创建一个绑定同一端口的UdpSocket(SO_REUSEPORT)，
+内核按源地址把数据报分流到不同的socket，各loop之间没有共享状态
+*/
+class UdpServer : noncopyable
+{
+public:
+    using ThreadInitCallback = std::function<void(EventLoop *)>;
+
+    UdpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &nameArg,
+              size_t maxDatagramSize = UdpSocket::kDefaultMaxDatagramSize);
+    ~UdpServer();
+
+    // 设置底层subloop的个数 每个subloop一个socket
+    void setThreadNum(int numThreads);
+    void setThreadInitCallback(const ThreadInitCallback &cb) { threadInitCallback_ = cb; }
+    void setDatagramCallback(const DatagramCallback &cb) { datagramCallback_ = cb; }
+    // 设置后GRO合并的数据报整体交给该回调 见UdpSocket::setSegmentedDatagramCallback
+    void setSegmentedDatagramCallback(const SegmentedDatagramCallback &cb) { segmentedDatagramCallback_ = cb; }
+    // 在每个socket上开启UDP_GRO 需要在start之前调用，内核不支持时退回单个数据报
+    void setGroEnabled(bool on) { groEnabled_ = on; }
+
+    // 开启服务器
+    void start();
+
+    const std::string &name() const { return name_; }
+
+private:
+    void startSocketInLoop(UdpSocket *socket);
+
+    EventLoop *loop_; // baseloop
+    const InetAddress listenAddr_;
+    const std::string name_;
+    const size_t maxDatagramSize_;
+    std::shared_ptr<EventLoopThreadPool> threadPool_;
+    DatagramCallback datagramCallback_;
+    SegmentedDatagramCallback segmentedDatagramCallback_;
+    bool groEnabled_;
+    ThreadInitCallback threadInitCallback_;
+    std::atomic_int started_;
+    std::vector<std::unique_ptr<UdpSocket>> sockets_;
+};
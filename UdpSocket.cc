@@ -0,0 +1,354 @@
+#include "UdpSocket.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/time.h>
+#include <netinet/udp.h>
+#include <algorithm>
+
+const int UdpSocket::kBatchSize;
+const size_t UdpSocket::kDefaultMaxDatagramSize;
+const size_t UdpSocket::kMaxPendingBytes;
+const size_t UdpSocket::kMaxGsoBytes;
+const int UdpSocket::kMaxGsoSegments;
+
+// 一次可读事件中最多调用recvmmsg的次数，防止一个socket饿死同loop上的其他channel
+static const int kMaxBatchesPerEvent = 8;
+// 每个接收消息的控制缓冲区大小，足够放下SCM_TIMESTAMP和UDP_GRO
+static const size_t kControlSize = CMSG_SPACE(sizeof(struct timeval)) + CMSG_SPACE(sizeof(int));
+// 每个发送消息的控制缓冲区大小，放UDP_SEGMENT
+static const size_t kSendControlSize = CMSG_SPACE(sizeof(uint16_t));
+// GRO合并后的数据报最大可以到64K
+static const size_t kGroBufferSize = 65536;
+
+static int createNonblockingUdp(sa_family_t family)
+{
+    int sockfd = ::socket(family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_UDP);
+    if (sockfd < 0)
+    {
+        LOG_FATAL("%s:%s:%d udp socket create err: %d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return sockfd;
+}
+
+UdpSocket::UdpSocket(EventLoop *loop, const InetAddress &bindAddr, bool reuseport, size_t maxDatagramSize)
+    : loop_(loop),
+      socket_(createNonblockingUdp(bindAddr.family())),
+      channel_(loop, socket_.fd()),
+      localAddr_(bindAddr),
+      maxDatagramSize_(maxDatagramSize),
+      inReadBatch_(false),
+      groEnabled_(false),
+      gsoSupported_(false),
+      recvData_(kBatchSize * maxDatagramSize),
+      recvMsgs_(kBatchSize),
+      recvIovecs_(kBatchSize),
+      recvAddrs_(kBatchSize),
+      recvControl_(kBatchSize * kControlSize),
+      pendingHead_(0),
+      sendMsgs_(kBatchSize),
+      sendIovecs_(kBatchSize),
+      sendControl_(kBatchSize * kSendControlSize)
+{
+    socket_.setReuseAddr(true);
+    socket_.setReusePort(reuseport); // 多个loop各自绑定同一端口，由内核按四元组分流
+    int on = 1;
+    ::setsockopt(socket_.fd(), SOL_SOCKET, SO_TIMESTAMP, &on, sizeof on);
+    socket_.bindAddress(bindAddr);
+
+    // 能读取UDP_SEGMENT选项说明内核支持GSO(4.18+)
+    int gsoSize = 0;
+    socklen_t optlen = sizeof gsoSize;
+    gsoSupported_ = ::getsockopt(socket_.fd(), IPPROTO_UDP, UDP_SEGMENT, &gsoSize, &optlen) == 0;
+
+    localAddr_ = InetAddress::localAddressOf(socket_.fd());
+
+    channel_.setReadCallback(std::bind(&UdpSocket::handleRead, this, std::placeholders::_1));
+    channel_.setWriteCallback(std::bind(&UdpSocket::handleWrite, this));
+}
+
+UdpSocket::~UdpSocket()
+{
+    channel_.disableAll();
+    channel_.remove();
+}
+
+void UdpSocket::start()
+{
+    channel_.enableReading();
+}
+
+bool UdpSocket::enableGro()
+{
+    int on = 1;
+    if (::setsockopt(socket_.fd(), IPPROTO_UDP, UDP_GRO, &on, sizeof on) != 0)
+    {
+        LOG_INFO("UdpSocket fd=%d UDP_GRO not supported:%d, fall back to single datagrams \n", socket_.fd(), errno);
+        return false;
+    }
+    groEnabled_ = true;
+    if (maxDatagramSize_ < kGroBufferSize)
+    {
+        // 合并后的数据报可能远大于单个数据报，接收缓冲区需要放得下
+        maxDatagramSize_ = kGroBufferSize;
+        recvData_.resize(kBatchSize * maxDatagramSize_);
+    }
+    return true;
+}
+
+int UdpSocket::groSegmentSize(msghdr *hdr)
+{
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(hdr, cmsg))
+    {
+        if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO)
+        {
+            int segmentSize = 0;
+            memcpy(&segmentSize, CMSG_DATA(cmsg), sizeof segmentSize);
+            return segmentSize;
+        }
+    }
+    return 0;
+}
+
+void UdpSocket::deliver(const char *data, size_t len, size_t segmentSize, const InetAddress &peer, Timestamp receiveTime)
+{
+    if (segmentedDatagramCallback_)
+    {
+        segmentedDatagramCallback_(this, data, len, segmentSize, peer, receiveTime);
+    }
+    else if (datagramCallback_)
+    {
+        // 用户只关心单个数据报，把GRO合并的数据拆开逐个上报
+        if (len == 0 || segmentSize >= len)
+        {
+            // 没有合并的单个数据报 包括长度为0的数据报
+            datagramCallback_(this, data, len, peer, receiveTime);
+            return;
+        }
+        size_t step = std::max<size_t>(segmentSize, 1);
+        for (size_t offset = 0; offset < len; offset += step)
+        {
+            datagramCallback_(this, data + offset, std::min(step, len - offset), peer, receiveTime);
+        }
+    }
+}
+
+Timestamp UdpSocket::receiveTimestamp(msghdr *hdr, Timestamp fallback)
+{
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(hdr, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMP)
+        {
+            struct timeval tv;
+            memcpy(&tv, CMSG_DATA(cmsg), sizeof tv);
+            return Timestamp(static_cast<int64_t>(tv.tv_sec) * Timestamp::kMicroSecondsPerSecond + tv.tv_usec);
+        }
+    }
+    return fallback;
+}
+
+void UdpSocket::handleRead(Timestamp receiveTime)
+{
+    inReadBatch_ = true;
+    for (int batch = 0; batch < kMaxBatchesPerEvent; ++batch)
+    {
+        // 每次调用前都要重置长度字段，内核会改写它们
+        for (int i = 0; i < kBatchSize; ++i)
+        {
+            recvIovecs_[i].iov_base = &recvData_[i * maxDatagramSize_];
+            recvIovecs_[i].iov_len = maxDatagramSize_;
+            msghdr &hdr = recvMsgs_[i].msg_hdr;
+            hdr.msg_name = &recvAddrs_[i];
+            hdr.msg_namelen = sizeof(sockaddr_in6);
+            hdr.msg_iov = &recvIovecs_[i];
+            hdr.msg_iovlen = 1;
+            hdr.msg_control = &recvControl_[i * kControlSize];
+            hdr.msg_controllen = kControlSize;
+            hdr.msg_flags = 0;
+            recvMsgs_[i].msg_len = 0;
+        }
+
+        int n = ::recvmmsg(socket_.fd(), &recvMsgs_[0], kBatchSize, MSG_DONTWAIT, nullptr);
+        if (n < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                LOG_ERROR("UdpSocket::handleRead recvmmsg error:%d \n", errno);
+            }
+            break;
+        }
+
+        for (int i = 0; i < n; ++i)
+        {
+            msghdr &hdr = recvMsgs_[i].msg_hdr;
+            if (hdr.msg_flags & MSG_TRUNC)
+            {
+                LOG_ERROR("UdpSocket fd=%d datagram truncated to %lu bytes \n", socket_.fd(), maxDatagramSize_);
+            }
+            size_t len = recvMsgs_[i].msg_len;
+            int segmentSize = groEnabled_ ? groSegmentSize(&hdr) : 0;
+            InetAddress peer;
+            peer.setSockAddr(reinterpret_cast<const sockaddr *>(&recvAddrs_[i]), hdr.msg_namelen);
+            deliver(static_cast<const char *>(recvIovecs_[i].iov_base), len,
+                    segmentSize > 0 ? segmentSize : len, peer, receiveTimestamp(&hdr, receiveTime));
+        }
+
+        if (n < kBatchSize)
+        {
+            break; // 接收队列已经读空
+        }
+    }
+    inReadBatch_ = false;
+
+    flushPending();
+}
+
+void UdpSocket::sendTo(const void *data, size_t len, const InetAddress &peer)
+{
+    enqueue(data, len, 0, peer);
+}
+
+void UdpSocket::sendSegmented(const void *data, size_t len, size_t segmentSize, const InetAddress &peer)
+{
+    const char *p = static_cast<const char *>(data);
+    if (segmentSize == 0 || len <= segmentSize)
+    {
+        enqueue(p, len, 0, peer);
+        return;
+    }
+
+    if (gsoSupported_ && segmentSize <= kMaxGsoBytes)
+    {
+        // 每个GSO数据报最多kMaxGsoSegments个分段，且总长度不超过kMaxGsoBytes
+        size_t segments = std::min(static_cast<size_t>(kMaxGsoSegments), kMaxGsoBytes / segmentSize);
+        size_t chunk = segments * segmentSize;
+        for (size_t offset = 0; offset < len; offset += chunk)
+        {
+            size_t n = std::min(chunk, len - offset);
+            enqueue(p + offset, n, n > segmentSize ? static_cast<uint16_t>(segmentSize) : 0, peer);
+        }
+    }
+    else
+    {
+        for (size_t offset = 0; offset < len; offset += segmentSize)
+        {
+            enqueue(p + offset, std::min(segmentSize, len - offset), 0, peer);
+        }
+    }
+}
+
+void UdpSocket::enqueue(const void *data, size_t len, uint16_t segmentSize, const InetAddress &peer)
+{
+    if (pendingBuffer_.readableBytes() + len > kMaxPendingBytes)
+    {
+        // UDP本身不可靠，发送队列积压过多时直接丢弃
+        LOG_ERROR("UdpSocket fd=%d pending queue full, drop %lu bytes \n", socket_.fd(), len);
+        return;
+    }
+
+    PendingDatagram d;
+    d.len = len;
+    d.segmentSize = segmentSize;
+    d.peer = peer;
+    pending_.push_back(d);
+    pendingBuffer_.append(static_cast<const char *>(data), len);
+
+    if (!inReadBatch_ && !channel_.isWriting())
+    {
+        flushPending();
+    }
+}
+
+void UdpSocket::flushPending()
+{
+    while (pendingHead_ < pending_.size())
+    {
+        int count = 0;
+        const char *base = pendingBuffer_.peek();
+        size_t offset = 0;
+        for (size_t i = pendingHead_; i < pending_.size() && count < kBatchSize; ++i, ++count)
+        {
+            PendingDatagram &d = pending_[i];
+            sendIovecs_[count].iov_base = const_cast<char *>(base + offset);
+            sendIovecs_[count].iov_len = d.len;
+            msghdr &hdr = sendMsgs_[count].msg_hdr;
+            memset(&hdr, 0, sizeof hdr);
+            hdr.msg_name = const_cast<sockaddr *>(d.peer.getSockAddr());
+            hdr.msg_namelen = d.peer.getSockLen();
+            hdr.msg_iov = &sendIovecs_[count];
+            hdr.msg_iovlen = 1;
+            if (d.segmentSize > 0)
+            {
+                char *control = &sendControl_[count * kSendControlSize];
+                hdr.msg_control = control;
+                hdr.msg_controllen = kSendControlSize;
+                cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+                cmsg->cmsg_level = IPPROTO_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                memcpy(CMSG_DATA(cmsg), &d.segmentSize, sizeof d.segmentSize);
+            }
+            offset += d.len;
+        }
+
+        int n = ::sendmmsg(socket_.fd(), &sendMsgs_[0], count, MSG_DONTWAIT);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break; // 发送缓冲区满 等待EPOLLOUT
+            }
+            PendingDatagram &head = pending_[pendingHead_];
+            if (head.segmentSize > 0 && (errno == EIO || errno == EINVAL))
+            {
+                // 网卡或内核不支持GSO，把队首的GSO数据报就地拆成普通数据报重发，数据在缓冲区中本来就是连续的
+                LOG_INFO("UdpSocket fd=%d UDP_SEGMENT failed:%d, fall back to single datagrams \n", socket_.fd(), errno);
+                gsoSupported_ = false;
+                std::vector<PendingDatagram> split;
+                for (size_t offset = 0; offset < head.len; offset += head.segmentSize)
+                {
+                    PendingDatagram d = head;
+                    d.len = std::min(static_cast<size_t>(head.segmentSize), head.len - offset);
+                    d.segmentSize = 0;
+                    split.push_back(d);
+                }
+                pending_.erase(pending_.begin() + pendingHead_);
+                pending_.insert(pending_.begin() + pendingHead_, split.begin(), split.end());
+                continue;
+            }
+            // 目标不可达等错误只影响队首的数据报，丢弃后继续
+            LOG_ERROR("UdpSocket::flushPending sendmmsg error:%d \n", errno);
+            n = 1;
+        }
+
+        size_t sent = 0;
+        for (int i = 0; i < n; ++i)
+        {
+            sent += pending_[pendingHead_ + i].len;
+        }
+        pendingBuffer_.retrieve(sent);
+        pendingHead_ += n;
+    }
+
+    if (pendingHead_ == pending_.size())
+    {
+        pending_.clear();
+        pendingHead_ = 0;
+        if (channel_.isWriting())
+        {
+            channel_.disableWriting();
+        }
+    }
+    else if (!channel_.isWriting())
+    {
+        channel_.enableWriting();
+    }
+}
+
+void UdpSocket::handleWrite()
+{
+    flushPending();
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Socket.h"
+#include "Channel.h"
+#include "InetAddress.h"
+#include "Buffer.h"
+#include "Callbacks.h"
+
+#include <vector>
+#include <memory>
+#include <sys/socket.h>
+
+class EventLoop;
+
+/*
+UDP通道 每个loop持有自己的UdpSocket和预分配的mmsghdr数组
+可读时用recvmmsg一次收取一批数据报，回调中产生的回复先排队，
+本批回调结束后用sendmmsg一次发出
+内核支持时可以开启UDP_SEGMENT(GSO)发送和UDP_GRO接收，不支持时自动退化为逐个数据报处理
+*/
+class UdpSocket : noncopyable
+{
+public:
+    static const int kBatchSize = 32;                   // 每次recvmmsg/sendmmsg最多处理的数据报个数
+    static const size_t kDefaultMaxDatagramSize = 2048; // 默认的单个数据报接收缓冲大小
+    static const size_t kMaxPendingBytes = 4 * 1024 * 1024;
+    static const size_t kMaxGsoBytes = 65000; // 一次GSO发送的最大字节数
+    static const int kMaxGsoSegments = 64;     // 内核限制的一次GSO最多分段数
+
+    UdpSocket(EventLoop *loop, const InetAddress &bindAddr, bool reuseport,
+              size_t maxDatagramSize = kDefaultMaxDatagramSize);
+    ~UdpSocket();
+
+    void setDatagramCallback(const DatagramCallback &cb) { datagramCallback_ = cb; }
+    // 设置后GRO合并的数据报整体交给该回调，否则拆分成单个数据报交给DatagramCallback
+    void setSegmentedDatagramCallback(const SegmentedDatagramCallback &cb) { segmentedDatagramCallback_ = cb; }
+
+    // 开启UDP_GRO接收 需要在start之前调用，返回内核是否支持
+    bool enableGro();
+    bool groEnabled() const { return groEnabled_; }
+    // 内核是否支持UDP_SEGMENT发送
+    bool gsoSupported() const { return gsoSupported_; }
+
+    // 开始接收数据 只能在loop线程中调用
+    void start();
+    // 发送一个数据报 只能在loop线程中调用，在回调中调用时会和同批次的回复一起发送
+    void sendTo(const void *data, size_t len, const InetAddress &peer);
+    // 把data按segmentSize切分成多个数据报发送给peer，支持GSO时由内核切分
+    void sendSegmented(const void *data, size_t len, size_t segmentSize, const InetAddress &peer);
+
+    EventLoop *getLoop() const { return loop_; }
+    int fd() const { return socket_.fd(); }
+    // 尚未发出的字节数 可用于发送端的流量控制
+    size_t pendingBytes() const { return pendingBuffer_.readableBytes(); }
+    const InetAddress &localAddress() const { return localAddr_; }
+
+private:
+    struct PendingDatagram
+    {
+        size_t len;
+        uint16_t segmentSize; // 非0表示这是一个GSO数据报
+        InetAddress peer;
+    };
+
+    void handleRead(Timestamp receiveTime);
+    void handleWrite();
+    // 把排队的数据报用sendmmsg发出，内核发送缓冲区满时注册EPOLLOUT
+    void flushPending();
+    void enqueue(const void *data, size_t len, uint16_t segmentSize, const InetAddress &peer);
+    void deliver(const char *data, size_t len, size_t segmentSize, const InetAddress &peer, Timestamp receiveTime);
+    // 从cmsg中取出GRO的分段大小 没有合并时返回0
+    static int groSegmentSize(msghdr *hdr);
+    // 从cmsg中取出内核接收时间戳
+    static Timestamp receiveTimestamp(msghdr *hdr, Timestamp fallback);
+
+    EventLoop *loop_;
+    Socket socket_;
+    Channel channel_;
+    InetAddress localAddr_;
+    size_t maxDatagramSize_;
+    bool inReadBatch_;
+    bool groEnabled_;
+    bool gsoSupported_;
+
+    // 预分配的接收数组 每次recvmmsg复用
+    std::vector<char> recvData_;
+    std::vector<mmsghdr> recvMsgs_;
+    std::vector<iovec> recvIovecs_;
+    std::vector<sockaddr_in6> recvAddrs_; // 足够放下IPv4和IPv6地址
+    std::vector<char> recvControl_;
+
+    // 待发送的数据报 数据连续存放在pendingBuffer_中
+    Buffer pendingBuffer_;
+    std::vector<PendingDatagram> pending_;
+    size_t pendingHead_;
+    std::vector<mmsghdr> sendMsgs_;
+    std::vector<iovec> sendIovecs_;
+    std::vector<char> sendControl_;
+
+    DatagramCallback datagramCallback_;
+    SegmentedDatagramCallback segmentedDatagramCallback_;
+};
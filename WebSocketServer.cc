@@ -0,0 +1,530 @@
+#include "WebSocketServer.h"
+#include "HttpContext.h"
+#include "Logger.h"
+#include "BufferSearch.h"
+
+#include <string.h>
+#include <stdint.h>
+
+const size_t WebSocketConnection::kCoalesceThreshold;
+const size_t WebSocketServer::kDefaultMaxMessageSize;
+
+namespace
+{
+    const char kWebSocketGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+    // ---------------- 握手用的SHA1和base64 只在建立连接时调用一次 ----------------
+    inline uint32_t rol(uint32_t value, int bits)
+    {
+        return (value << bits) | (value >> (32 - bits));
+    }
+
+    void sha1(const std::string &input, unsigned char digest[20])
+    {
+        uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+        std::string msg(input);
+        uint64_t bitLen = static_cast<uint64_t>(input.size()) * 8;
+        msg.push_back(static_cast<char>(0x80));
+        while (msg.size() % 64 != 56)
+        {
+            msg.push_back('\0');
+        }
+        for (int i = 7; i >= 0; --i)
+        {
+            msg.push_back(static_cast<char>((bitLen >> (i * 8)) & 0xff));
+        }
+
+        for (size_t chunk = 0; chunk < msg.size(); chunk += 64)
+        {
+            uint32_t w[80];
+            for (int i = 0; i < 16; ++i)
+            {
+                const unsigned char *p = reinterpret_cast<const unsigned char *>(&msg[chunk + i * 4]);
+                w[i] = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+            }
+            for (int i = 16; i < 80; ++i)
+            {
+                w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+            }
+
+            uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+            for (int i = 0; i < 80; ++i)
+            {
+                uint32_t f, k;
+                if (i < 20)
+                {
+                    f = (b & c) | (~b & d);
+                    k = 0x5A827999;
+                }
+                else if (i < 40)
+                {
+                    f = b ^ c ^ d;
+                    k = 0x6ED9EBA1;
+                }
+                else if (i < 60)
+                {
+                    f = (b & c) | (b & d) | (c & d);
+                    k = 0x8F1BBCDC;
+                }
+                else
+                {
+                    f = b ^ c ^ d;
+                    k = 0xCA62C1D6;
+                }
+                uint32_t temp = rol(a, 5) + f + e + k + w[i];
+                e = d;
+                d = c;
+                c = rol(b, 30);
+                b = a;
+                a = temp;
+            }
+            h[0] += a;
+            h[1] += b;
+            h[2] += c;
+            h[3] += d;
+            h[4] += e;
+        }
+
+        for (int i = 0; i < 5; ++i)
+        {
+            digest[i * 4] = static_cast<unsigned char>(h[i] >> 24);
+            digest[i * 4 + 1] = static_cast<unsigned char>(h[i] >> 16);
+            digest[i * 4 + 2] = static_cast<unsigned char>(h[i] >> 8);
+            digest[i * 4 + 3] = static_cast<unsigned char>(h[i]);
+        }
+    }
+
+    std::string base64Encode(const unsigned char *data, size_t len)
+    {
+        static const char kTable[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        std::string out;
+        for (size_t i = 0; i < len; i += 3)
+        {
+            uint32_t n = uint32_t(data[i]) << 16;
+            if (i + 1 < len)
+                n |= uint32_t(data[i + 1]) << 8;
+            if (i + 2 < len)
+                n |= uint32_t(data[i + 2]);
+            out.push_back(kTable[(n >> 18) & 63]);
+            out.push_back(kTable[(n >> 12) & 63]);
+            out.push_back(i + 1 < len ? kTable[(n >> 6) & 63] : '=');
+            out.push_back(i + 2 < len ? kTable[n & 63] : '=');
+        }
+        return out;
+    }
+
+    // 逗号分隔的头部值中是否有token 不区分大小写 如Connection: keep-alive, Upgrade
+    bool hasToken(StringPiece value, const char *token)
+    {
+        while (!value.empty())
+        {
+            const char *comma = static_cast<const char *>(memchr(value.data(), ',', value.size()));
+            size_t len = comma ? static_cast<size_t>(comma - value.data()) : value.size();
+            StringPiece item(value.data(), len);
+            while (!item.empty() && (item[0] == ' ' || item[0] == '\t'))
+            {
+                item.removePrefix(1);
+            }
+            while (!item.empty() && (item[item.size() - 1] == ' ' || item[item.size() - 1] == '\t'))
+            {
+                item = StringPiece(item.data(), item.size() - 1);
+            }
+            if (item.equalsIgnoreCase(token))
+            {
+                return true;
+            }
+            value.removePrefix(comma ? len + 1 : len);
+        }
+        return false;
+    }
+}
+
+WebSocketConnection::WebSocketConnection(const TcpConnectionPtr &conn)
+    : conn_(conn),
+      loop_(conn->getLoop()),
+      handshake_(new HttpContext),
+      fragmentOpcode_(kText),
+      flushScheduled_(false),
+      closing_(false)
+{
+}
+
+WebSocketConnection::~WebSocketConnection() = default;
+
+void WebSocketConnection::appendFrameHeader(Buffer *buf, Opcode opcode, size_t len)
+{
+    // 服务端发出的帧不带掩码
+    buf->appendInt8(static_cast<int8_t>(0x80 | opcode));
+    if (len < 126)
+    {
+        buf->appendInt8(static_cast<int8_t>(len));
+    }
+    else if (len <= 0xFFFF)
+    {
+        buf->appendInt8(126);
+        buf->appendInt16(static_cast<int16_t>(len));
+    }
+    else
+    {
+        buf->appendInt8(127);
+        buf->appendInt64(static_cast<int64_t>(len));
+    }
+}
+
+void WebSocketConnection::send(Opcode opcode, const void *data, size_t len)
+{
+    if (loop_->isInLoopThread())
+    {
+        sendInLoop(opcode, static_cast<const char *>(data), len);
+    }
+    else
+    {
+        loop_->runInLoop(std::bind(&WebSocketConnection::sendStringInLoop, shared_from_this(), opcode,
+                                   std::string(static_cast<const char *>(data), len)));
+    }
+}
+
+void WebSocketConnection::sendStringInLoop(Opcode opcode, const std::string &data)
+{
+    sendInLoop(opcode, data.data(), data.size());
+}
+
+void WebSocketConnection::sendInLoop(Opcode opcode, const char *data, size_t len)
+{
+    if (!pending_)
+    {
+        pending_.reset(new Buffer(256));
+    }
+    appendFrameHeader(pending_.get(), opcode, len);
+    pending_->append(data, len);
+    scheduleFlush();
+}
+
+void WebSocketConnection::send(Opcode opcode, Buffer *payload)
+{
+    size_t len = payload->readableBytes();
+    bool nothingPending = !pending_ || pending_->readableBytes() == 0;
+    if (len >= kCoalesceThreshold && len <= 0xFFFF && nothingPending)
+    {
+        // 大帧直接在payload的kCheapPrepend预留区写入4字节帧头，不拷贝payload
+        TcpConnectionPtr conn = conn_.lock();
+        if (conn)
+        {
+            payload->prependInt16(static_cast<int16_t>(len));
+            payload->prependInt8(126);
+            payload->prependInt8(static_cast<int8_t>(0x80 | opcode));
+            conn->send(payload);
+        }
+        return;
+    }
+    sendInLoop(opcode, payload->peek(), len);
+    payload->retrieveAll();
+}
+
+void WebSocketConnection::close(uint16_t code)
+{
+    if (loop_->isInLoopThread())
+    {
+        closeInLoop(code);
+    }
+    else
+    {
+        loop_->runInLoop(std::bind(&WebSocketConnection::closeInLoop, shared_from_this(), code));
+    }
+}
+
+void WebSocketConnection::closeInLoop(uint16_t code)
+{
+    if (!closing_)
+    {
+        closing_ = true;
+        uint16_t be = htobe16(code);
+        sendInLoop(kClose, reinterpret_cast<const char *>(&be), sizeof be);
+    }
+}
+
+void WebSocketConnection::scheduleFlush()
+{
+    if (!flushScheduled_)
+    {
+        // 本轮事件循环结束时(doPendingFunctors)统一发送
+        flushScheduled_ = true;
+        loop_->queueInLoop(std::bind(&WebSocketConnection::flush, shared_from_this()));
+    }
+}
+
+void WebSocketConnection::flush()
+{
+    flushScheduled_ = false;
+    TcpConnectionPtr conn = conn_.lock();
+    if (conn && pending_ && pending_->readableBytes() > 0)
+    {
+        conn->send(pending_.get());
+        if (closing_)
+        {
+            conn->shutdown();
+        }
+    }
+    // 空闲连接不保留发送缓冲
+    pending_.reset();
+}
+
+WebSocketServer::WebSocketServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &name, TcpServer::Option option)
+    : server_(loop, listenAddr, name, option),
+      maxMessageSize_(kDefaultMaxMessageSize)
+{
+    server_.setConnectionCallback(std::bind(&WebSocketServer::onConnection, this, std::placeholders::_1));
+    server_.setMessageCallback(std::bind(&WebSocketServer::onMessage, this,
+                                         std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+void WebSocketServer::start()
+{
+    server_.start();
+}
+
+void WebSocketServer::onConnection(const TcpConnectionPtr &conn)
+{
+    if (conn->connected())
+    {
+        conn->setContext(std::make_shared<WebSocketConnection>(conn));
+    }
+    else
+    {
+        WebSocketConnectionPtr ws = std::static_pointer_cast<WebSocketConnection>(conn->getContext());
+        if (ws && ws->upgraded() && closedCallback_)
+        {
+            closedCallback_(ws);
+        }
+        conn->setContext(std::shared_ptr<void>());
+    }
+}
+
+void WebSocketServer::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+{
+    WebSocketConnectionPtr ws = std::static_pointer_cast<WebSocketConnection>(conn->getContext());
+    if (!ws->upgraded())
+    {
+        if (!handleHandshake(conn, ws, buf, receiveTime) || !ws->upgraded())
+        {
+            return;
+        }
+    }
+    handleFrames(ws, buf);
+}
+
+bool WebSocketServer::handleHandshake(const TcpConnectionPtr &conn, const WebSocketConnectionPtr &ws, Buffer *buf, Timestamp receiveTime)
+{
+    HttpContext *context = ws->handshake_.get();
+    HttpContext::ParseResult result = context->parse(buf, receiveTime);
+    if (result == HttpContext::kIncomplete)
+    {
+        return true;
+    }
+
+    Buffer response;
+    const HttpRequest &req = context->request();
+    StringPiece key = req.getHeader("Sec-WebSocket-Key");
+    if (result == HttpContext::kError || req.method() != HttpRequest::kGet ||
+        !req.getHeader("Upgrade").equalsIgnoreCase("websocket") ||
+        !hasToken(req.getHeader("Connection"), "Upgrade") || key.empty())
+    {
+        const char kBadRequest[] = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        response.append(kBadRequest, sizeof kBadRequest - 1);
+        conn->send(&response);
+        conn->shutdown();
+        buf->retrieveAll();
+        return false;
+    }
+    if (req.getHeader("Sec-WebSocket-Version") != "13")
+    {
+        // RFC 6455 4.4 只支持13，用426告诉客户端支持的版本
+        const char kUpgradeRequired[] = "HTTP/1.1 426 Upgrade Required\r\nSec-WebSocket-Version: 13\r\n"
+                                        "Content-Length: 0\r\nConnection: close\r\n\r\n";
+        response.append(kUpgradeRequired, sizeof kUpgradeRequired - 1);
+        conn->send(&response);
+        conn->shutdown();
+        buf->retrieveAll();
+        return false;
+    }
+
+    unsigned char digest[20];
+    sha1(key.asString() + kWebSocketGuid, digest);
+    std::string accept = base64Encode(digest, sizeof digest);
+
+    const char kSwitching[] = "HTTP/1.1 101 Switching Protocols\r\n"
+                              "Upgrade: websocket\r\n"
+                              "Connection: Upgrade\r\n"
+                              "Sec-WebSocket-Accept: ";
+    response.append(kSwitching, sizeof kSwitching - 1);
+    response.append(accept.data(), accept.size());
+    response.append("\r\n\r\n", 4);
+    conn->send(&response);
+
+    buf->retrieve(context->requestLength());
+    ws->handshake_.reset(); // 握手完成 释放解析器
+    if (openCallback_)
+    {
+        openCallback_(ws);
+    }
+    return true;
+}
+
+/*
+ 0                   1                   2                   3
+ +-+-+-+-+-------+-+-------------+-------------------------------+
+ |F|R|R|R| opcode|M| Payload len |    Extended payload length    |
+ |I|S|S|S|  (4)  |A|     (7)     |             (16/64)           |
+ +-+-+-+-+-------+-+-------------+-------------------------------+
+ |  Masking-key (4, 客户端帧必须有)  |          Payload Data         |
+*/
+void WebSocketServer::handleFrames(const WebSocketConnectionPtr &ws, Buffer *buf)
+{
+    TcpConnectionPtr conn = ws->tcpConnection();
+    while (conn && buf->readableBytes() >= 2)
+    {
+        if (ws->closing_)
+        {
+            // 已经发出或收到关闭帧 之后的帧都丢弃
+            buf->retrieveAll();
+            return;
+        }
+
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(buf->peek());
+        bool fin = p[0] & 0x80;
+        int opcode = p[0] & 0x0F;
+        bool masked = p[1] & 0x80;
+        uint64_t len = p[1] & 0x7F;
+        size_t headerLen = 2;
+
+        if ((p[0] & 0x70) || !masked)
+        {
+            // 没有协商扩展时RSV必须为0，客户端帧必须带掩码
+            ws->close(1002);
+            buf->retrieveAll();
+            return;
+        }
+
+        if (len == 126)
+        {
+            if (buf->readableBytes() < 4)
+                return;
+            len = (uint64_t(p[2]) << 8) | p[3];
+            headerLen = 4;
+        }
+        else if (len == 127)
+        {
+            if (buf->readableBytes() < 10)
+                return;
+            len = 0;
+            for (int i = 0; i < 8; ++i)
+            {
+                len = (len << 8) | p[2 + i];
+            }
+            headerLen = 10;
+        }
+
+        if (opcode >= WebSocketConnection::kClose && (!fin || len > 125))
+        {
+            // RFC 6455 5.5 控制帧不能分片，payload不超过125字节
+            ws->close(1002);
+            buf->retrieveAll();
+            return;
+        }
+
+        if (len > maxMessageSize_)
+        {
+            ws->close(1009);
+            buf->retrieveAll();
+            return;
+        }
+
+        if (buf->readableBytes() < headerLen + 4 + len)
+        {
+            return; // 帧不完整
+        }
+
+        uint32_t key;
+        memcpy(&key, p + headerLen, 4);
+        headerLen += 4;
+        char *payload = buf->mutablePeek() + headerLen;
+        BufferSearch::xorMask(payload, static_cast<size_t>(len), key);
+
+        switch (opcode)
+        {
+        case WebSocketConnection::kText:
+        case WebSocketConnection::kBinary:
+            if (ws->fragments_)
+            {
+                // 分片消息还没结束时不能开始新的数据帧 RFC 6455 5.4
+                ws->close(1002);
+                buf->retrieveAll();
+                return;
+            }
+            if (fin)
+            {
+                // 未分片的消息直接交给用户 不拷贝
+                if (messageCallback_)
+                {
+                    messageCallback_(ws, payload, static_cast<size_t>(len), opcode == WebSocketConnection::kBinary);
+                }
+            }
+            else
+            {
+                if (!ws->fragments_)
+                {
+                    ws->fragments_.reset(new Buffer);
+                }
+                ws->fragments_->retrieveAll();
+                ws->fragments_->append(payload, static_cast<size_t>(len));
+                ws->fragmentOpcode_ = static_cast<WebSocketConnection::Opcode>(opcode);
+            }
+            break;
+
+        case WebSocketConnection::kContinuation:
+            if (!ws->fragments_ || ws->fragments_->readableBytes() + len > maxMessageSize_)
+            {
+                ws->close(ws->fragments_ ? 1009 : 1002);
+                buf->retrieveAll();
+                return;
+            }
+            ws->fragments_->append(payload, static_cast<size_t>(len));
+            if (fin)
+            {
+                if (messageCallback_)
+                {
+                    messageCallback_(ws, ws->fragments_->peek(), ws->fragments_->readableBytes(),
+                                     ws->fragmentOpcode_ == WebSocketConnection::kBinary);
+                }
+                ws->fragments_.reset();
+            }
+            break;
+
+        case WebSocketConnection::kPing:
+            ws->send(WebSocketConnection::kPong, payload, static_cast<size_t>(len));
+            break;
+
+        case WebSocketConnection::kPong:
+            break;
+
+        case WebSocketConnection::kClose:
+        {
+            uint16_t code = 1000;
+            if (len >= 2)
+            {
+                code = static_cast<uint16_t>((uint8_t(payload[0]) << 8) | uint8_t(payload[1]));
+            }
+            ws->close(code); // 回应关闭帧，发送完成后关闭写端
+            buf->retrieveAll();
+            return;
+        }
+
+        default:
+            ws->close(1002);
+            buf->retrieveAll();
+            return;
+        }
+
+        buf->retrieve(headerLen + static_cast<size_t>(len));
+    }
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "TcpServer.h"
+#include "Buffer.h"
+
+#include <functional>
+#include <string>
+#include <memory>
+
+class HttpContext;
+class WebSocketConnection;
+using WebSocketConnectionPtr = std::shared_ptr<WebSocketConnection>;
+
+/*
+一个已经完成握手的WebSocket连接，保存在TcpConnection的context中
+同一轮事件循环中发送的小帧先写入pending缓冲区，本轮结束时合并成一次write
+*/
+class WebSocketConnection : noncopyable, public std::enable_shared_from_this<WebSocketConnection>
+{
+public:
+    enum Opcode
+    {
+        kContinuation = 0x0,
+        kText = 0x1,
+        kBinary = 0x2,
+        kClose = 0x8,
+        kPing = 0x9,
+        kPong = 0xA
+    };
+
+    // 超过该大小且没有待合并的帧时，直接在payload的预留区写帧头发送
+    static const size_t kCoalesceThreshold = 4096;
+
+    explicit WebSocketConnection(const TcpConnectionPtr &conn);
+    ~WebSocketConnection();
+
+    // 线程安全 其他线程调用时会拷贝数据转到loop线程
+    void sendText(const std::string &text) { send(kText, text.data(), text.size()); }
+    void sendBinary(const void *data, size_t len) { send(kBinary, data, len); }
+    void send(Opcode opcode, const void *data, size_t len);
+    // 在loop线程中调用，payload中的数据被取走
+    void send(Opcode opcode, Buffer *payload);
+    // 线程安全 发送关闭帧并在发送完成后关闭写端
+    void close(uint16_t code = 1000);
+
+    TcpConnectionPtr tcpConnection() const { return conn_.lock(); }
+    bool upgraded() const { return handshake_ == nullptr; }
+
+private:
+    friend class WebSocketServer;
+
+    void sendInLoop(Opcode opcode, const char *data, size_t len);
+    void sendStringInLoop(Opcode opcode, const std::string &data);
+    void closeInLoop(uint16_t code);
+    void appendFrameHeader(Buffer *buf, Opcode opcode, size_t len);
+    void scheduleFlush();
+    void flush();
+
+    std::weak_ptr<TcpConnection> conn_;
+    EventLoop *loop_;
+    std::unique_ptr<HttpContext> handshake_; // 握手完成后释放
+    std::unique_ptr<Buffer> pending_;        // 待合并发送的帧 按需分配，空闲连接不占内存
+    std::unique_ptr<Buffer> fragments_;      // 分片消息的拼接缓冲 按需分配
+    Opcode fragmentOpcode_;
+    bool flushScheduled_;
+    bool closing_;
+};
+
+/*
+WebSocket服务器 握手阶段复用HttpContext解析升级请求
+帧在输入Buffer中就地解码，客户端掩码用BufferSearch::xorMask就地去除，未分片的消息直接以指针+长度交给回调
+*/
+class WebSocketServer : noncopyable
+{
+public:
+    using OpenCallback = std::function<void(const WebSocketConnectionPtr &)>;
+    using ClosedCallback = std::function<void(const WebSocketConnectionPtr &)>;
+    // data只在回调期间有效
+    using WebSocketMessageCallback = std::function<void(const WebSocketConnectionPtr &,
+                                                        const char *data,
+                                                        size_t len,
+                                                        bool binary)>;
+
+    static const size_t kDefaultMaxMessageSize = 16 * 1024 * 1024;
+
+    WebSocketServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &name,
+                    TcpServer::Option option = TcpServer::kNoReusePort);
+
+    void setThreadNum(int numThreads) { server_.setThreadNum(numThreads); }
+    void setOpenCallback(const OpenCallback &cb) { openCallback_ = cb; }
+    void setClosedCallback(const ClosedCallback &cb) { closedCallback_ = cb; }
+    void setMessageCallback(const WebSocketMessageCallback &cb) { messageCallback_ = cb; }
+    void setMaxMessageSize(size_t size) { maxMessageSize_ = size; }
+
+    void start();
+
+private:
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+    // 返回false表示握手失败，连接已关闭
+    bool handleHandshake(const TcpConnectionPtr &conn, const WebSocketConnectionPtr &ws, Buffer *buf, Timestamp receiveTime);
+    void handleFrames(const WebSocketConnectionPtr &ws, Buffer *buf);
+
+    TcpServer server_;
+    OpenCallback openCallback_;
+    ClosedCallback closedCallback_;
+    WebSocketMessageCallback messageCallback_;
+    size_t maxMessageSize_;
+};
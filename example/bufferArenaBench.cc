@@ -0,0 +1,149 @@
+#include <mymuduo_rewrite/Buffer.h>
+#include <mymuduo_rewrite/BufferArena.h>
+#include <mymuduo_rewrite/EventLoop.h>
+#include <mymuduo_rewrite/Timestamp.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <memory>
+#include <random>
+#include <vector>
+
+/*
+Buffer底层存储的对比：原来基于std::vector<char>的实现、malloc分配器、每个loop的BufferArena
+模拟kConnections个连接的缓冲区，大部分消息很小，少数是几十KB的大消息，
+消息追加后按一定概率被取走，同时不断有连接关闭和新建
+每种存储在单独的子进程中运行，分别统计吞吐和结束时的RSS
+*/
+
+static const int kConnections = 20000;
+static const int kSteps = 4000000;
+
+// 原来的Buffer存储方式 扩容时vector::resize会把新增部分清零
+class VectorBuffer
+{
+public:
+    VectorBuffer() : buffer_(Buffer::kCheapPrepend + Buffer::kInitialSize), readerIndex_(Buffer::kCheapPrepend), writerIndex_(Buffer::kCheapPrepend) {}
+
+    void append(const char *data, size_t len)
+    {
+        if (buffer_.size() - writerIndex_ < len)
+        {
+            if (buffer_.size() - writerIndex_ + readerIndex_ < len + Buffer::kCheapPrepend)
+            {
+                buffer_.resize(writerIndex_ + len);
+            }
+            else
+            {
+                size_t readable = writerIndex_ - readerIndex_;
+                std::copy(&buffer_[readerIndex_], &buffer_[writerIndex_], &buffer_[Buffer::kCheapPrepend]);
+                readerIndex_ = Buffer::kCheapPrepend;
+                writerIndex_ = readerIndex_ + readable;
+            }
+        }
+        std::copy(data, data + len, &buffer_[writerIndex_]);
+        writerIndex_ += len;
+    }
+
+    void retrieveAll()
+    {
+        readerIndex_ = Buffer::kCheapPrepend;
+        writerIndex_ = Buffer::kCheapPrepend;
+    }
+
+private:
+    std::vector<char> buffer_;
+    size_t readerIndex_;
+    size_t writerIndex_;
+};
+
+static size_t residentBytes()
+{
+    long pages = 0;
+    long resident = 0;
+    FILE *fp = ::fopen("/proc/self/statm", "r");
+    if (fp)
+    {
+        if (::fscanf(fp, "%ld %ld", &pages, &resident) != 2)
+        {
+            resident = 0;
+        }
+        ::fclose(fp);
+    }
+    return static_cast<size_t>(resident) * ::sysconf(_SC_PAGESIZE);
+}
+
+template <typename BufferType, typename Factory>
+static void runOnce(const char *label, Factory factory)
+{
+    std::vector<std::unique_ptr<BufferType>> buffers;
+    buffers.reserve(kConnections);
+    for (int i = 0; i < kConnections; ++i)
+    {
+        buffers.emplace_back(factory());
+    }
+
+    std::mt19937 rng(42);
+    std::string payload(64 * 1024, 'x');
+    size_t bytes = 0;
+    int64_t start = Timestamp::monotonicNanoSeconds();
+    for (int step = 0; step < kSteps; ++step)
+    {
+        uint32_t r = rng();
+        BufferType &buf = *buffers[r % kConnections];
+        // 95%的消息在512字节以内 其余是4KB到64KB的大消息
+        size_t len = (r >> 16) % 100 < 95 ? 16 + (r >> 8) % 496 : 4096 + rng() % (60 * 1024);
+        buf.append(payload.data(), len);
+        bytes += len;
+        uint32_t action = (r >> 24) % 100;
+        if (action < 70)
+        {
+            buf.retrieveAll();
+        }
+        else if (action < 71)
+        {
+            // 连接关闭 新连接复用这个位置
+            buffers[r % kConnections].reset(factory());
+        }
+    }
+    double seconds = static_cast<double>(Timestamp::monotonicNanoSeconds() - start) / Timestamp::kNanoSecondsPerSecond;
+    printf("%-8s %8.0f kops/s  %8.1f MB/s  rss %7.1f MB\n", label, kSteps / seconds / 1000,
+           bytes / seconds / (1024 * 1024), residentBytes() / (1024.0 * 1024));
+}
+
+// 每种存储在子进程中运行 RSS互不影响
+template <typename Fn>
+static void forkAndRun(Fn fn)
+{
+    pid_t pid = ::fork();
+    if (pid == 0)
+    {
+        fn();
+        ::fflush(stdout);
+        ::_exit(0);
+    }
+    ::waitpid(pid, nullptr, 0);
+}
+
+int main()
+{
+    printf("%d buffers, %d appends\n", kConnections, kSteps);
+    ::fflush(stdout);
+    forkAndRun([]()
+               { runOnce<VectorBuffer>("vector", []()
+                                       { return new VectorBuffer; }); });
+    forkAndRun([]()
+               { runOnce<Buffer>("heap", []()
+                                 { return new Buffer; }); });
+    forkAndRun([]()
+               {
+                   EventLoop loop;
+                   BufferArena *arena = loop.bufferArena();
+                   runOnce<Buffer>("arena", [arena]()
+                                   { return new Buffer(Buffer::kInitialSize, arena); });
+                   BufferArena::Stats stats = arena->stats();
+                   printf("arena    %lu regions (%lu MAP_HUGETLB)\n", stats.regions, stats.hugeRegions); });
+    return 0;
+}
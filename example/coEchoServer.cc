@@ -0,0 +1,46 @@
+#include <mymuduo_rewrite/TcpServer.h>
+#include <mymuduo_rewrite/Coroutine.h>
+#include <mymuduo_rewrite/Logger.h>
+
+#include <string>
+
+/*
+协程版的行回显服务 需要用-std=c++20编译
+每个连接一个协程：读一行，模拟一次耗时操作，回显后继续读，直到对端关闭
+*/
+CoTask<> echoSession(EventLoop *loop, CoConnection conn)
+{
+    for (;;)
+    {
+        std::string line = co_await conn.readUntil("\n");
+        if (line.empty())
+        {
+            break;
+        }
+        if (line == "sleep\n")
+        {
+            co_await coSleep(loop, 0.1);
+        }
+        if (!co_await conn.write(line))
+        {
+            break;
+        }
+    }
+    LOG_INFO("session %s finished", conn.connection() ? conn.connection()->name().c_str() : "closed");
+}
+
+int main()
+{
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(8000), "CoEchoServer");
+    server.setConnectionCallback([](const TcpConnectionPtr &conn)
+                                 {
+                                     if (conn->connected())
+                                     {
+                                         coSpawn(echoSession(conn->getLoop(), CoConnection(conn)));
+                                     } });
+    server.setThreadNum(2);
+    server.start();
+    loop.loop();
+    return 0;
+}
@@ -0,0 +1,48 @@
+#include <mymuduo_rewrite/Buffer.h>
+#include <mymuduo_rewrite/Timestamp.h>
+
+#include <stdio.h>
+#include <random>
+#include <string>
+
+/*
+线性缓冲区和镜像映射环形缓冲区的对比
+模拟流式收包：每次追加一段kReadSize字节的数据(相当于一次readFd)，然后解析出其中完整的帧，
+帧长在kMinFrame到kMaxFrame之间随机，每次解析完都会在缓冲区里留下半个帧
+线性缓冲区下次追加时要先把剩下的半个帧挪回开头，环形缓冲区不需要
+*/
+
+static const size_t kReadSize = 16 * 1024;
+static const size_t kMinFrame = 64;
+static const size_t kMaxFrame = 4096;
+static const int kReads = 500000;
+
+static void runOnce(const char *label, BufferAllocator *allocator)
+{
+    Buffer buf(Buffer::kInitialSize, allocator);
+    std::mt19937 rng(42);
+    std::string chunk(kReadSize, 'x');
+    size_t frames = 0;
+    size_t pending = kMinFrame + rng() % (kMaxFrame - kMinFrame);
+    int64_t start = Timestamp::monotonicNanoSeconds();
+    for (int i = 0; i < kReads; ++i)
+    {
+        buf.append(chunk.data(), chunk.size());
+        while (buf.readableBytes() >= pending)
+        {
+            buf.retrieve(pending);
+            ++frames;
+            pending = kMinFrame + rng() % (kMaxFrame - kMinFrame);
+        }
+    }
+    double seconds = static_cast<double>(Timestamp::monotonicNanoSeconds() - start) / Timestamp::kNanoSecondsPerSecond;
+    printf("%-8s %8.1f MB/s  %8.0f kframes/s  capacity %lu\n", label,
+           kReads * kReadSize / seconds / (1024 * 1024), frames / seconds / 1000, buf.internalCapacity());
+}
+
+int main()
+{
+    runOnce("linear", BufferAllocator::heap());
+    runOnce("mirrored", BufferAllocator::mirrored());
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include <mymuduo_rewrite/UdpSocket.h>
+#include <mymuduo_rewrite/EventLoop.h>
+#include <mymuduo_rewrite/EventLoopThread.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <string>
+
+/*
+回环地址上的UDP吞吐对比
+off: 每个数据报单独排队，sendmmsg批量发送，接收端不开GRO
+on : sendSegmented由内核GSO切分，接收端开启UDP_GRO
+统计接收端每秒收到的数据报个数(GRO合并的按分段计数)
+*/
+
+static const uint16_t kPort = 9990;
+static const double kSeconds = 2.0;
+static const size_t kSegmentSize = 1200;
+static const size_t kBurstBytes = 60 * kSegmentSize;
+
+static std::atomic<int64_t> g_received(0);
+
+static void runClient(bool offload, std::atomic<bool> *done)
+{
+    EventLoop loop;
+    UdpSocket client(&loop, InetAddress(0), false);
+    client.start();
+    InetAddress server(kPort);
+    std::string burst(kBurstBytes, 'x');
+
+    // 自我重复投递的任务，发送队列清空后再放入下一批，空闲时poll会立即返回处理EPOLLOUT
+    std::function<void()> pump;
+    pump = [&]()
+    {
+        if (*done)
+        {
+            loop.quit();
+            return;
+        }
+        if (client.pendingBytes() == 0)
+        {
+            if (offload)
+            {
+                client.sendSegmented(burst.data(), burst.size(), kSegmentSize, server);
+            }
+            else
+            {
+                for (size_t offset = 0; offset < burst.size(); offset += kSegmentSize)
+                {
+                    client.sendTo(burst.data() + offset, kSegmentSize, server);
+                }
+            }
+        }
+        loop.queueInLoop(pump);
+    };
+    loop.queueInLoop(pump);
+    loop.wakeup(); // 之后在doPendingFunctors中再投递时loop会自己唤醒
+    loop.loop();
+}
+
+static double runOnce(bool offload)
+{
+    EventLoopThread serverThread;
+    EventLoop *serverLoop = serverThread.startLoop();
+    UdpSocket *server = new UdpSocket(serverLoop, InetAddress(kPort), false);
+    if (offload && !server->enableGro())
+    {
+        printf("UDP_GRO not supported, receive side falls back to single datagrams\n");
+    }
+    server->setSegmentedDatagramCallback([](UdpSocket *, const char *, size_t len, size_t segmentSize,
+                                            const InetAddress &, Timestamp)
+                                         { g_received += (len + segmentSize - 1) / segmentSize; });
+    serverLoop->runInLoop([server]()
+                          { server->start(); });
+
+    g_received = 0;
+    std::atomic<bool> done(false);
+    Thread clientThread(std::bind(&runClient, offload, &done));
+    Timestamp start(Timestamp::now());
+    clientThread.start();
+    ::usleep(static_cast<useconds_t>(kSeconds * 1000 * 1000));
+    done = true;
+    clientThread.join();
+    double elapsed = timeDifference(Timestamp::now(), start);
+    int64_t received = g_received;
+
+    serverLoop->runInLoop([server]()
+                          { delete server; });
+    return received / elapsed;
+}
+
+int main()
+{
+    double off = runOnce(false);
+    printf("offload off: %.0f datagrams/s\n", off);
+    double on = runOnce(true);
+    printf("offload on : %.0f datagrams/s (%.2fx)\n", on, on / off);
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include <mymuduo_rewrite/TcpServer.h>
+#include <mymuduo_rewrite/TcpClient.h>
+#include <mymuduo_rewrite/EventLoop.h>
+#include <mymuduo_rewrite/EventLoopThread.h>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/*
+回环TCP和Unix域socket的往返延迟对比
+服务端echo，客户端每次发送一个kMessageSize字节的消息，收到完整回显后再发下一个
+*/
+
+static const int kRounds = 20000;
+static const size_t kMessageSize = 64;
+
+static void runOnce(const char *label, const InetAddress &addr)
+{
+    EventLoopThread serverThread;
+    EventLoop *serverLoop = serverThread.startLoop();
+    TcpServer *server = nullptr;
+    serverLoop->runInLoop([&]()
+                          {
+                              server = new TcpServer(serverLoop, addr, "bench");
+                              server->setConnectionCallback([](const TcpConnectionPtr &) {});
+                              server->setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                                                         { conn->send(buf); });
+                              server->start(); });
+    ::usleep(100 * 1000); // 等服务端开始监听，避免客户端第一次connect被拒绝后进入重试等待
+
+    EventLoop loop;
+    TcpClient client(&loop, addr, "bench-client");
+    std::string message(kMessageSize, 'x');
+    std::vector<int64_t> rtts;
+    rtts.reserve(kRounds);
+    Timestamp sendTime;
+
+    client.setConnectionCallback([&](const TcpConnectionPtr &conn)
+                                 {
+                                     if (conn->connected())
+                                     {
+                                         sendTime = Timestamp::now();
+                                         conn->send(message);
+                                     } });
+    client.setMessageCallback([&](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                              {
+                                  if (buf->readableBytes() < kMessageSize)
+                                  {
+                                      return;
+                                  }
+                                  buf->retrieve(kMessageSize);
+                                  Timestamp now(Timestamp::now());
+                                  rtts.push_back(now.microSecondsSinceEpoch() - sendTime.microSecondsSinceEpoch());
+                                  if (static_cast<int>(rtts.size()) == kRounds)
+                                  {
+                                      conn->shutdown();
+                                      loop.quit();
+                                      return;
+                                  }
+                                  sendTime = now;
+                                  conn->send(message); });
+    client.connect();
+    loop.loop();
+    client.disconnect();
+
+    serverLoop->runInLoop([server]()
+                          { delete server; });
+
+    std::sort(rtts.begin(), rtts.end());
+    int64_t total = 0;
+    for (int64_t rtt : rtts)
+    {
+        total += rtt;
+    }
+    printf("%-22s avg %6.2f us  p50 %4ld us  p99 %4ld us\n", label,
+           static_cast<double>(total) / rtts.size(), rtts[rtts.size() / 2], rtts[rtts.size() * 99 / 100]);
+}
+
+int main()
+{
+    runOnce("tcp 127.0.0.1", InetAddress(9991));
+    runOnce("tcp [::1]", InetAddress(9992, "::1"));
+    runOnce("unix /tmp path", InetAddress::unixDomain("/tmp/mymuduo-bench.sock"));
+    runOnce("unix abstract", InetAddress::unixDomain("@mymuduo-bench"));
+    ::unlink("/tmp/mymuduo-bench.sock");
+    return 0;
+}